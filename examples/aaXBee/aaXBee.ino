@@ -11,7 +11,9 @@
 // repository: http://github.com/JChristensen/aaXBee_HW
 //
 // This basic sketch sends a sequence number, the temperature from the
-// MCP9808, battery and regulator voltages.
+// MCP9808, battery and regulator voltages. To save battery, the data is
+// only sent when a reading has changed significantly, or at least every
+// HEARTBEAT_INTERVAL seconds.
 //
 // Developed with Arduino 1.0.6, updated for 1.8.19.
 // Set ATmega328P Fuses (L/H/E): 0x7F, 0xDE, 0x06.
@@ -47,6 +49,7 @@
 #include <avr/sleep.h>
 #include <avr/wdt.h>
 #include <DS3232RTC.h>      // https://github.com/JChristensen/DS3232RTC
+#include <gsDeadband.h>     // https://github.com/JChristensen/GroveStreams
 #include <gsXBee.h>         // https://github.com/JChristensen/gsXBee
 #include <MCP9808.h>        // https://github.com/JChristensen/MCP9808
 #include <Streaming.h>      // https://github.com/janelia-arduino/Streaming
@@ -57,6 +60,17 @@
 
 //parameters
 const uint32_t XBEE_TIMEOUT(10000);      //ms to wait for ack
+const uint32_t HEARTBEAT_INTERVAL(3600); //maximum seconds between transmissions
+const int T_DEADBAND(4);                 //temperature change to send, in MCP9808 units
+const int V_DEADBAND(2);                 //voltage change to send, percent
+
+gsDeadband DB;
+
+//the deadband filter needs a clock that keeps time while the MCU sleeps
+uint32_t rtcMillis()
+{
+    return RTC.get() * 1000UL;
+}
 
 //trap the MCUSR value after reset to determine the reset source
 //and ensure the watchdog is reset. this code does not work with a bootloader.
@@ -74,6 +88,10 @@ void wdt_init()
 void setup()
 {
     Circuit.begin( F(__FILE__) );
+    DB.clock = rtcMillis;
+    DB.setRule("tRaw", T_DEADBAND, false, HEARTBEAT_INTERVAL * 1000UL);
+    DB.setRule("vBat", V_DEADBAND, true, HEARTBEAT_INTERVAL * 1000UL);
+    DB.setRule("vReg", V_DEADBAND, true, HEARTBEAT_INTERVAL * 1000UL);
 }
 
 void loop()
@@ -127,6 +145,14 @@ void loop()
             Serial << millis() << ' ';
             printDateTime(rtcTime);
 
+            //skip the transmission if nothing has changed much
+            if ( !DB.filter(XB.compID, buf) )
+            {
+                Serial << millis() << F(" No change, ") << DB.suppression() << F("% suppressed\n");
+                STATE = SET_ALARM;
+                break;
+            }
+
             //Send the data
             Circuit.xbeeEnable(true);
             while ( XB.read() != NO_TRAFFIC );    //handle any incoming traffic
@@ -4,8 +4,9 @@
 // GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
 
 // Example sketch: Basic GroveStreams Client
-// Sends data from an analog temperature sensor to GroveStreams,
-// once per minute.
+// Sends data from an analog temperature sensor to GroveStreams.
+// The temperature is read once per minute, but only sent when it has
+// changed by more than C_DEADBAND, or at least every HEARTBEAT_INTERVAL.
 //
 // Before running this sketch, create an account and an Organization
 // on GroveStreams. From the start page, click the Organization name
@@ -22,6 +23,8 @@
 // a minute, refresh the Observation Studio page to see these.
 //
 // v1.0  Developed with Arduino v1.0.6, updated for 1.8.19.
+// v1.1  Format the data with the library's payload builder.
+// v1.2  Only send significant changes in temperature.
 //
 // Hardware:
 //   Arduino Uno
@@ -34,6 +37,7 @@
 #include <SPI.h>
 #include <Streaming.h>      // https://github.com/janelia-arduino/Streaming
 #include <GroveStreams.h>   // https://github.com/JChristensen/GroveStreams
+#include <gsDeadband.h>     // part of the GroveStreams library
 
 //installation-specific variables that WILL need to be changed
 PROGMEM const char gsApiKey[] = "Put *YOUR* GroveStreams API key here";
@@ -42,7 +46,9 @@ const char gsCompID[] = "analog";               //GroveStreams component ID
 
 //other global variables
 const char* gsServer = "grovestreams.com";
-const uint32_t XMIT_INTERVAL(60000);            //data transmission interval
+const uint32_t XMIT_INTERVAL(60000);            //data sampling interval
+const uint32_t HEARTBEAT_INTERVAL(900000);      //maximum interval between transmissions
+const float C_DEADBAND(0.25);                   //temperature change to send, degrees C
 const uint32_t HB_INTERVAL(1000);               //heartbeat LED interval, ms
 const uint32_t DHCP_RENEW_INTERVAL(3600000);    //renew our IP address hourly
 const int32_t BAUD_RATE(115200);
@@ -56,6 +62,7 @@ const uint8_t TMP36(A2);     //TMP36 temperature sensor (A0 and A1 are used for
 //object instantiations
 EthernetClient gsClient;
 GroveStreams GS(gsClient, gsServer, (const __FlashStringHelper*)gsApiKey, WAIT_LED);
+gsDeadband DB;
 
 void setup()
 {
@@ -78,6 +85,7 @@ void setup()
     }
     Serial << millis() << F(" Ethernet started ") << Ethernet.localIP() << endl;
     GS.begin();                          //connect to GroveStreams
+    DB.setRule("C", C_DEADBAND, false, HEARTBEAT_INTERVAL);
     wdt_enable(WDTO_8S);                 //guard against network hangs, etc.
 }
 
@@ -91,19 +99,25 @@ void loop()
     {
         msLastXmit += XMIT_INTERVAL;
         static uint16_t seqNbr;
-        char buf[40];
         int tC100 = readTMP36(TMP36);
-        int intDegrees = tC100 / 100;
-        int fracDegrees = abs(tC100 % 100);
-        sprintf(buf, "&s=%u&C=%i.%i", ++seqNbr, intDegrees, fracDegrees );
-        Serial << endl << millis() << F(" Sending ") << buf << endl;
-        if ( GS.send(gsCompID, buf) == SEND_ACCEPTED )
+        if ( !DB.changed(gsCompID, "C", tC100 / 100.0) )
         {
-            Serial << millis() << F(" Send OK\n");
+            Serial << endl << millis() << F(" No change ") << tC100 << F(", ") << DB.suppression() << F("% suppressed\n");
         }
         else
         {
-            Serial << millis() << F(" Send FAIL\n");
+            Serial << endl << millis() << F(" Sending ") << ++seqNbr << ' ' << tC100 << endl;
+            GS.sendBegin(gsCompID);
+            GS.addInt("s", seqNbr);
+            GS.addFixed("C", tC100, 2);
+            if ( GS.sendEnd() == SEND_ACCEPTED )
+            {
+                Serial << millis() << F(" Send OK\n");
+            }
+            else
+            {
+                Serial << millis() << F(" Send FAIL\n");
+            }
         }
     }
 
@@ -0,0 +1,202 @@
+// Arduino GroveStreams Library
+// https://github.com/JChristensen/GroveStreams
+// Copyright (C) 2015-2024 by Jack Christensen and licensed under
+// GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+
+// Example sketch: GroveStreams Send Pipeline Benchmark
+// Drives GroveStreams.send() and run() at a series of offered loads
+// and reports, for each load:
+//   - samples per second offered, accepted and delivered,
+//   - p50/p95/p99 connect and response latency,
+//   - average and maximum run() execution time,
+//   - bytes sent per delivered sample.
+//
+// Change the batching and keep-alive settings below to compare them.
+// GroveStreams limits PUTs to one every 10 seconds (averaged over two
+// minutes), so for anything but the lowest loads, point gsServer at a
+// stand-in web server on the local network that accepts PUTs to
+// /api/feed and answers "HTTP/1.1 200 OK", and set PUT_LIMIT to false.
+//
+// v1.0  Developed with Arduino 1.8.19.
+// v1.1  Added PUT_LIMIT.
+// v1.2  Print the library's RAM use.
+//
+// Hardware:
+//   Arduino Uno or Mega
+//   Arduino Ethernet Shield
+
+#include <Ethernet.h>
+#include <SPI.h>
+#include <Streaming.h>      // https://github.com/janelia-arduino/Streaming
+#include <GroveStreams.h>   // https://github.com/JChristensen/GroveStreams
+
+//installation-specific variables that WILL need to be changed
+PROGMEM const char gsApiKey[] = "Put *YOUR* GroveStreams API key here";
+uint8_t macAddr[6] = { 0, 2, 0, 0, 0, 0x43 };   //Put YOUR MAC address here
+const char* gsServer = "grovestreams.com";      //or a local stand-in server
+
+//benchmark settings
+const uint32_t BATCH_WINDOW(0);             //ms, zero for no batching
+const bool KEEP_ALIVE(false);               //reuse connections
+const bool PUT_LIMIT(true);                 //pace PUTs to the GroveStreams limit
+const uint8_t N_COMPONENTS(4);              //simulated components, sends are spread across them
+const uint32_t STEP_DURATION(60000);        //ms to run each load step
+const uint16_t OFFERED_LOAD[] = { 100, 200, 500, 1000, 2000 };  //offered load for each step, samples per 100 seconds
+const uint8_t N_STEPS( sizeof(OFFERED_LOAD) / sizeof(OFFERED_LOAD[0]) );
+const uint8_t MAX_LATENCY(64);              //latency samples kept per step for percentiles
+const int32_t BAUD_RATE(115200);
+
+//pin assignments
+const uint8_t SD_CARD(4);    //slave select signal for the SD card on the Ethernet shield
+const uint8_t WAIT_LED(7);   //waiting for server response
+
+//object instantiations
+EthernetClient gsClient;
+GroveStreams GS(gsClient, gsServer, (const __FlashStringHelper*)gsApiKey, WAIT_LED);
+
+//per-step measurements
+struct stepStats_t
+{
+    uint32_t offered;       //sends attempted
+    uint32_t accepted;      //sends accepted by the library
+    uint32_t delivered;     //samples in PUTs that got HTTP OK
+    uint32_t runCalls;      //calls to run()
+    uint32_t runTimeSum;    //total run() execution time, us
+    uint32_t runTimeMax;    //longest run() execution time, us
+    uint32_t bytesStart;    //GS.bytesSent at the start of the step
+    uint8_t nConn;          //number of connect latency samples
+    uint8_t nResp;          //number of response latency samples
+    uint16_t connMs[MAX_LATENCY];
+    uint16_t respMs[MAX_LATENCY];
+} stats;
+
+void setup()
+{
+    Serial.begin(BAUD_RATE);
+    pinMode(SD_CARD, OUTPUT);
+    digitalWrite(SD_CARD, HIGH);         //de-select the SD card
+    pinMode(WAIT_LED, OUTPUT);
+    Serial << F( "\n" __FILE__ " " __DATE__ " " __TIME__ "\n" );
+    delay(500);                          //allow some time for the ethernet chip to boot up
+
+    if ( !Ethernet.begin(macAddr) )      //DHCP
+    {
+        Serial << millis() << F(" DHCP fail, reset in 60 seconds...\n");
+        Serial.flush();
+        GS.mcuReset(60000);
+    }
+    Serial << millis() << F(" Ethernet started ") << Ethernet.localIP() << endl;
+    GS.batchWindow = BATCH_WINDOW;
+    GS.keepAlive = KEEP_ALIVE;
+    if (!PUT_LIMIT) GS.putInterval = 0;
+    GS.begin();
+    GroveStreams::ramReport(Serial);
+    Serial << F("batchWindow=") << BATCH_WINDOW << F(" keepAlive=") << KEEP_ALIVE << F(" putLimit=") << PUT_LIMIT << endl;
+}
+
+void loop()
+{
+    static uint8_t step;
+    static uint32_t msStepStart, msLastSend, msPutComplete;
+    static uint8_t putSize;
+    static bool started;
+
+    if (step >= N_STEPS) return;        //all done
+
+    if (!started)
+    {
+        started = true;
+        memset(&stats, 0, sizeof(stats));
+        stats.bytesStart = GS.bytesSent;
+        msStepStart = msLastSend = millis();
+        Serial << endl << millis() << F(" Step ") << step + 1 << F(", offered load ")
+            << OFFERED_LOAD[step] / 100 << '.' << (OFFERED_LOAD[step] % 100 < 10 ? "0" : "") << OFFERED_LOAD[step] % 100 << F(" samples/s\n");
+    }
+
+    //offer samples at the step's rate
+    uint32_t interval = 100000UL / OFFERED_LOAD[step];
+    if ( millis() - msLastSend >= interval )
+    {
+        msLastSend += interval;
+        char compID[8], buf[40];
+        uint8_t comp = stats.offered % N_COMPONENTS;
+        sprintf(compID, "bench%u", comp);
+        sprintf(buf, "&seq=%lu&v=%u", (unsigned long)stats.offered, analogRead(A0));
+        ++stats.offered;
+        if ( GS.send(compID, buf) == SEND_ACCEPTED ) ++stats.accepted;
+    }
+
+    //run the library and collect measurements
+    ethernetStatus_t gsStatus = GS.run();
+    ++stats.runCalls;
+    stats.runTimeSum += GS.runTime;
+    if (GS.runTime > stats.runTimeMax) stats.runTimeMax = GS.runTime;
+
+    switch (gsStatus)
+    {
+    case PUT_COMPLETE:
+        msPutComplete = millis();
+        putSize = GS.batchSize;
+        if (stats.nConn < MAX_LATENCY) stats.connMs[stats.nConn++] = GS.connTime;
+        break;
+
+    case HTTP_OK:
+    case HTTP_OTHER:
+        if (stats.nResp < MAX_LATENCY) stats.respMs[stats.nResp++] = millis() - msPutComplete;
+        if (gsStatus == HTTP_OK) stats.delivered += putSize;
+        break;
+
+    default:
+        break;
+    }
+
+    //end of step, report
+    if ( millis() - msStepStart >= STEP_DURATION )
+    {
+        report();
+        started = false;
+        if (++step >= N_STEPS) Serial << endl << millis() << F(" Benchmark complete\n");
+    }
+}
+
+//print the results for a step
+void report()
+{
+    uint32_t secs = STEP_DURATION / 1000;
+    uint32_t bytes = GS.bytesSent - stats.bytesStart;
+
+    Serial << F("  samples/s offered ") << stats.offered / secs << '.' << (stats.offered * 10 / secs) % 10
+        << F(", accepted ") << stats.accepted / secs << '.' << (stats.accepted * 10 / secs) % 10
+        << F(", delivered ") << stats.delivered / secs << '.' << (stats.delivered * 10 / secs) % 10 << endl;
+    Serial << F("  connect ms  ");
+    printPercentiles(stats.connMs, stats.nConn);
+    Serial << F("  response ms ");
+    printPercentiles(stats.respMs, stats.nResp);
+    Serial << F("  run() us avg ") << (stats.runCalls ? stats.runTimeSum / stats.runCalls : 0)
+        << F(", max ") << stats.runTimeMax << endl;
+    Serial << F("  bytes/sample ") << (stats.delivered ? bytes / stats.delivered : 0)
+        << F(", queue max ") << GS.queueMax << F(", rejected ") << stats.offered - stats.accepted << endl;
+}
+
+//sort the samples and print the 50th, 95th and 99th percentiles
+void printPercentiles(uint16_t* ms, uint8_t n)
+{
+    if (n == 0)
+    {
+        Serial << F("no samples\n");
+        return;
+    }
+    for (uint8_t i = 1; i < n; i++)     //insertion sort
+    {
+        uint16_t v = ms[i];
+        uint8_t j = i;
+        while (j > 0 && ms[j-1] > v)
+        {
+            ms[j] = ms[j-1];
+            --j;
+        }
+        ms[j] = v;
+    }
+    Serial << F("p50 ") << ms[(n - 1) * 50 / 100] << F(", p95 ") << ms[(n - 1) * 95 / 100]
+        << F(", p99 ") << ms[(n - 1) * 99 / 100] << F(" (") << n << F(" samples)\n");
+}
@@ -11,18 +11,26 @@
 // GroveStreams limits PUTs to one every 10 seconds, but this is
 // averaged over a two-minute period. If multiple sensors send data
 // to the gateway asynchronously, it's possible for two or more
-// messages to arrive in a short interval. This sketch contains retry
-// code to address this situation by retrying a failed call to the
-// to GroveStreams.send() function. This works for the occasional
-// collision, but if more than a very few sensors are feeding the
-// gateway, some mechanism of synchronizing and spacing data
-// transmissions would be preferable. The retry mechanism also relies
-// somewhat on the XBee's ability to buffer messages, which is limited
-// by the internal memory available in the XBee, and will vary with
-// message size and frequency.
+// messages to arrive in a short interval. The GroveStreams library
+// queues these and paces the PUTs to stay within the limit, combining
+// queued sends into one PUT when the budget runs low, so the sketch only
+// has to report a failure if the queue is full. To serve more than a
+// few sensors, the gateway aggregates their data and sends a summary
+// (mean, minimum, maximum and number of samples) for each sensor every
+// SUMMARY_INTERVAL, leaving out their sequence numbers. The number of
+// sensors is then limited by the size of the aggregation table
+// (GS_AGG_SLOTS datastreams), not by the PUT limit. Data that cannot be
+// aggregated is sent as it is.
 //
 // v1.0  Developed with Arduino v1.0.6, updated for 1.8.19
 // v1.1  Added retry mechanism.
+// v1.2  Removed retry mechanism, the library now queues sends.
+// v1.3  Build the send in the library's queue rather than appending to the payload.
+// v1.4  Aggregate sensor data and send summaries.
+// v1.5  Stamp sends with the server time.
+// v1.6  Send the reset message as urgent, ahead of sensor data.
+// v1.7  Leave the sensors' sequence numbers out of the summaries.
+// v1.8  Send the signal strength on its own if the aggregator has no room for it.
 //
 // XBee Configuration
 // Model no. XB24-Z7WIT-004 (XB24-ZB)
@@ -41,6 +49,7 @@
 #include <Streaming.h>          // https://github.com/janelia-arduino/Streaming
 #include <XBee.h>               // https://github.com/andrewrapp/xbee-arduino
 #include <GroveStreams.h>       // https://github.com/JChristensen/GroveStreams
+#include <gsAggregator.h>       // part of the GroveStreams library
 #include <gsXBee.h>             // https://github.com/JChristensen/gsXBee
 
 //installation-specific variables that WILL need to be changed
@@ -52,8 +61,7 @@ const char* gsServer = "grovestreams.com";
 const uint32_t RESET_DELAY(60);             //seconds before resetting the MCU for initialization failures
 const uint32_t GS_INIT_TIMEOUT(10000);      //milliseconds to wait for GroveStreams response to initial message
 const uint32_t DHCP_RENEW_INTERVAL(3600);   //how often to renew our IP address, in seconds
-const uint32_t RETRY_INTERVAL(200);         //milliseconds between send retries
-const uint8_t MAX_TRIES(10);                //maximum number of times to try send
+const uint32_t SUMMARY_INTERVAL(300000);    //milliseconds between summaries of the sensor data
 
 //pin assignments
 const uint8_t SD_CARD(4);                   //slave select signal for the SD card on the Ethernet shield
@@ -65,6 +73,7 @@ const int32_t BAUD_RATE(115200);
 //object instantiations
 EthernetClient gsClient;
 GroveStreams GS(gsClient, gsServer, (const __FlashStringHelper*)gsApiKey, WAIT_LED);
+gsAggregator AGG(GS, SUMMARY_INTERVAL);
 gsXBee XB;
 
 void setup()
@@ -88,6 +97,8 @@ void setup()
         GS.mcuReset(RESET_DELAY * 1000UL);
     }
     Serial << millis() << F(" Ethernet started ") << Ethernet.localIP() << endl;
+    GS.timeStamp = true;                           //sends carry the time they were made
+    AGG.skip = "s,seq";                            //sequence numbers are not worth summarizing
     GS.begin();                                    //connect to GroveStreams
 
     //send an initial message to GroveStreams to verify communication
@@ -108,7 +119,7 @@ void setup()
         case GS_INIT_MSG:                              //send a message to GroveStreams to say we've reset
             STATE = GS_INIT_WAIT;
             msSend = millis();
-            GS.send(XB.compID, "&msg=MCU%20reset");
+            GS.send(XB.compID, "&msg=MCU%20reset", GS_URGENT);
             break;
 
         case GS_INIT_WAIT:
@@ -133,88 +144,68 @@ void setup()
 
 void loop()
 {
-    enum STATES_t
-    {
-        WAIT_INPUT, SEND_RETRY
-    };
-    static STATES_t STATE = WAIT_INPUT;
-
     wdt_reset();
     GS.run();                   // run the GroveStreams state machine
-    static uint32_t msSend;     // time of last GS.send
+    AGG.run();                  // send summaries when due
 
-    switch ( STATE )
+    if ( XB.read() == RX_DATA )                     //check for incoming data from the XBee
     {
-    case WAIT_INPUT:                                //wait for incoming data from the XBee
-        if ( XB.read() == RX_DATA )
+        if ( AGG.add(XB.sendingCompID, XB.payload) )
         {
-            char rss[8];
-            itoa(XB.rss, rss, 10);
-            strcat(XB.payload, "&rss=");
-            strcat(XB.payload, rss);
-            msSend = millis();
-            if ( GS.send(XB.sendingCompID, XB.payload) == SEND_ACCEPTED )
+            if ( AGG.addValue(XB.sendingCompID, "rss", XB.rss) )
             {
-                Serial << endl << millis() << F(" Send OK ") << XB.payload << endl;
+                Serial << endl << millis() << F(" Aggregated ") << XB.payload << F("&rss=") << XB.rss << endl;
             }
-            else
+            else                                    //no room for rss, send it on its own
             {
-                STATE = SEND_RETRY;
-                Serial << endl << millis() << F(" Send FAIL ") << XB.payload << endl;
+                Serial << endl << millis() << F(" Aggregated ") << XB.payload << endl;
+                GS.sendBegin(XB.sendingCompID);
+                GS.addInt("rss", XB.rss);
+                if ( GS.sendEnd() != SEND_ACCEPTED )
+                {
+                    Serial << millis() << F(" Send FAIL, queue full rss=") << XB.rss << endl;
+                }
             }
         }
-
-        //housekeeping stuff while we're waiting
+        else
         {
-            static uint32_t msLast;
-            static uint32_t uptimeSeconds;
-            static uint32_t lastMaintain;
-            uint32_t ms = millis();
-
-            //count uptime in seconds, print once per minute
-            if ( ms - msLast >= 1000 )
+            GS.sendBegin(XB.sendingCompID);
+            GS.addData(XB.payload);
+            GS.addInt("rss", XB.rss);
+            if ( GS.sendEnd() == SEND_ACCEPTED )
             {
-                msLast += 1000;
-                if ( ++uptimeSeconds % 60 == 0 )
-                {
-                    Serial << ms << F(" Approx uptime ") << uptimeSeconds/60 << F(" min.") << ' ' << endl;
-                }
+                Serial << endl << millis() << F(" Send OK ") << XB.payload << F("&rss=") << XB.rss << endl;
             }
-
-            //renew DHCP address regularly
-            if ( uptimeSeconds - lastMaintain >= DHCP_RENEW_INTERVAL )
+            else
             {
-                lastMaintain += DHCP_RENEW_INTERVAL;
-                Serial << ms << F(" Ethernet.maintain ") << Ethernet.maintain() << endl;
+                Serial << endl << millis() << F(" Send FAIL, queue full ") << XB.payload << endl;
             }
         }
-        break;
+    }
 
-    //initial call to GS.send() failed. retrying a few times should help if the reason was
-    //that more than one message arrived nearly simultaneously, before the GroveStreams
-    //site could respond to the first PUT.
-    case SEND_RETRY:
+    //housekeeping stuff while we're waiting
+    {
+        static uint32_t msLast;
+        static uint32_t uptimeSeconds;
+        static uint32_t lastMaintain;
+        uint32_t ms = millis();
+
+        //count uptime in seconds, print once per minute
+        if ( ms - msLast >= 1000 )
         {
-            static uint8_t retryCount;
-            if ( millis() - msSend >= RETRY_INTERVAL )
+            msLast += 1000;
+            if ( ++uptimeSeconds % 60 == 0 )
             {
-                msSend = millis();
-                Serial << millis() << F(" Send retry\n");
-                if ( GS.send(XB.sendingCompID, XB.payload) == SEND_ACCEPTED )
-                {
-                    STATE = WAIT_INPUT;
-                    Serial << endl << millis() << F(" Post OK, ") << retryCount + 2 << F(" tries ") << XB.payload << endl;
-                    retryCount = 0;
-                }
-                else if ( ++retryCount >= MAX_TRIES - 1 )
-                {
-                    STATE = WAIT_INPUT;
-                    Serial << endl << millis() << F(" Post FAIL, ") << ++retryCount << F(" tries ") << XB.payload << endl;
-                    retryCount = 0;
-                }
+                Serial << ms << F(" Approx uptime ") << uptimeSeconds/60 << F(" min.") << ' ' << endl;
             }
         }
-        break;
+
+        //renew DHCP address regularly
+        if ( uptimeSeconds - lastMaintain >= DHCP_RENEW_INTERVAL )
+        {
+            lastMaintain += DHCP_RENEW_INTERVAL;
+            Serial << ms << F(" Ethernet.maintain ") << Ethernet.maintain() << endl;
+        }
     }
 
     //run the heartbeat LED
@@ -0,0 +1,207 @@
+// Arduino GroveStreams Library
+// https://github.com/JChristensen/GroveStreams
+// Copyright (C) 2015-2024 by Jack Christensen and licensed under
+// GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+
+// Example sketch: GroveStreams Gateway Load Generator
+// Finds out how many sensor nodes a gateway can serve. Simulates a
+// network of XBee sensor nodes sending gsSensor and aaXBee style
+// payloads, and passes each one to the library the way gsGateway
+// does. The number of nodes is stepped up, and for each step the
+// sketch reports:
+//   - samples per second offered, and delivered (in PUTs that got HTTP OK),
+//   - the percentage dropped (queue full, circuit breaker open, or PUT failed),
+//   - p50/p95/p99 time that samples waited in the queue,
+//   - the number of PUTs, connections opened, requests retried on a
+//     stale keep-alive connection, and errors.
+//
+// Each node sends every NODE_INTERVAL ms, by its own clock, which is
+// off by up to SKEW_PPM. Nodes are started in groups of BURST_SIZE
+// that send at the same moment, like aaXBee nodes that share a
+// transmit schedule, and drift apart as their clocks differ.
+//
+// This is for the native build on Linux (see the gsPosix example, or
+// CMakeLists.txt in the library folder), and should be pointed at a
+// stand-in web server that accepts PUTs to /api/feed and answers
+// "HTTP/1.1 200 OK", e.g. extras/host/gsFakeServer.py, never at the
+// GroveStreams server. Compile the library with e.g.
+//   -DGS_POSIX -DGS_MAX_CONN=8
+//
+// v1.0  Developed with gcc 12 on Linux.
+// v1.1  Report connections and stale retries separately.
+
+#include <Streaming.h>          // https://github.com/janelia-arduino/Streaming
+#include <GroveStreams.h>       // https://github.com/JChristensen/GroveStreams
+#include <gsPosixClient.h>      // part of the GroveStreams library
+
+PROGMEM const char gsApiKey[] = "loadgen";
+const char* gsServer = "localhost";         //the stand-in server
+
+//load settings
+const uint16_t NODE_COUNTS[] = { 10, 50, 100, 200, 500, 1000 };   //simulated nodes for each step
+const uint8_t N_STEPS( sizeof(NODE_COUNTS) / sizeof(NODE_COUNTS[0]) );
+const uint16_t MAX_NODES(1000);             //largest number of nodes in any step
+const uint32_t NODE_INTERVAL(10000);        //ms between sends from each node
+const uint16_t BURST_SIZE(5);               //nodes that send at the same moment, 1 for none
+const int32_t SKEW_PPM(2000);               //maximum error of each node's clock, +/- ppm
+const uint32_t STEP_DURATION(60000);        //ms to run each step
+const uint32_t DRAIN_TIMEOUT(10000);        //ms to wait for the queue to empty between steps
+
+//gateway settings
+const uint32_t BATCH_WINDOW(500);           //ms to collect sends into a batch PUT, zero for no batching
+const bool KEEP_ALIVE(true);                //reuse connections
+const int32_t BAUD_RATE(115200);
+
+//object instantiations
+gsPosixLoop sockets;
+gsPosixClient* gsClients[GS_MAX_CONN];
+Client* gsPool[GS_MAX_CONN];
+GroveStreams* GS;
+
+//a simulated sensor node
+struct node_t
+{
+    uint32_t msNext;        //time of the next send
+    uint32_t interval;      //ms between sends, by the gateway's clock
+    uint16_t seq;           //sequence number
+} nodes[MAX_NODES];
+
+void setup()
+{
+    Serial.begin(BAUD_RATE);
+    Serial << F( "\n" __FILE__ " " __DATE__ " " __TIME__ "\n" );
+    if ( !sockets.begin() )
+    {
+        Serial << millis() << F(" epoll fail\n");
+        exit(1);
+    }
+    for (uint8_t i = 0; i < GS_MAX_CONN; i++)
+    {
+        gsClients[i] = new gsPosixClient(sockets);
+        gsPool[i] = gsClients[i];
+    }
+    GS = new GroveStreams(gsPool, GS_MAX_CONN, gsServer, (const __FlashStringHelper*)gsApiKey, -1);
+    GS->logLevel = GS_LOG_ERROR;
+    GS->batchWindow = BATCH_WINDOW;
+    GS->keepAlive = KEEP_ALIVE;
+    GS->putInterval = 0;                    //no PUT limit on the stand-in server
+    GS->begin();
+    Serial << F("connections=") << GS_MAX_CONN << F(" batchWindow=") << BATCH_WINDOW << F(" keepAlive=") << KEEP_ALIVE
+        << F(" nodeInterval=") << NODE_INTERVAL << F(" burst=") << BURST_SIZE << F(" skew=") << SKEW_PPM << endl;
+}
+
+void loop()
+{
+    static uint8_t step;
+    static uint16_t nNodes;
+    static uint32_t msStepStart, offered, connects;
+
+    if (step >= N_STEPS)
+    {
+        Serial << endl << millis() << F(" Load test complete\n");
+        exit(0);
+    }
+
+    if (nNodes == 0)
+    {
+        nNodes = NODE_COUNTS[step];
+        startNodes(nNodes);
+        GS->resetStats();
+        offered = 0;
+        connects = countConnects();
+        msStepStart = millis();
+        Serial << endl << millis() << F(" Step ") << step + 1 << F(", ") << nNodes << F(" nodes\n");
+    }
+
+    //let each node that is due send its data, as gsGateway would
+    uint32_t ms = millis();
+    for (uint16_t i = 0; i < nNodes; i++)
+    {
+        node_t& n = nodes[i];
+        if ( (int32_t)(ms - n.msNext) < 0 ) continue;
+        n.msNext += n.interval;
+        char compID[12], payload[48];
+        sprintf(compID, "sim%04u", i);
+        if (i % 2 == 0)     //gsSensor
+        {
+            sprintf(payload, "&s=%u&C=%i.%i", ++n.seq, 20 + i % 5, (int)random(10));
+        }
+        else                //aaXBee
+        {
+            sprintf(payload, "&seq=%u&tRaw=%i&vBat=%i&vReg=%i", ++n.seq, 350 + (int)random(20), 2900 - i % 200, 3300);
+        }
+        GS->sendBegin(compID);
+        GS->addData(payload);
+        GS->addInt("rss", 30 + random(60));
+        GS->sendEnd();
+        ++offered;
+    }
+
+    sockets.poll(0);
+    for (uint8_t i = 0; i < GS_MAX_CONN; i++) GS->run();
+
+    //end of step, let the queue empty, then report
+    if ( millis() - msStepStart >= STEP_DURATION )
+    {
+        uint32_t msDrain = millis();
+        while ( GS->queued > 0 && millis() - msDrain < DRAIN_TIMEOUT )
+        {
+            sockets.poll(1);
+            GS->run();
+        }
+        report(offered, countConnects() - connects);
+        nNodes = 0;
+        ++step;
+    }
+}
+
+//set up n nodes, in groups that start at the same moment, each with its own clock error
+void startNodes(uint16_t n)
+{
+    uint32_t ms = millis();
+    uint32_t start = ms;
+    for (uint16_t i = 0; i < n; i++)
+    {
+        if (i % BURST_SIZE == 0) start = ms + random(NODE_INTERVAL);
+        int32_t ppm = random(-SKEW_PPM, SKEW_PPM + 1);
+        nodes[i].interval = NODE_INTERVAL + (int32_t)NODE_INTERVAL * ppm / 1000000;
+        nodes[i].msNext = start;
+        nodes[i].seq = 0;
+    }
+}
+
+//connections started by all the clients in the pool
+uint32_t countConnects()
+{
+    uint32_t n = 0;
+    for (uint8_t i = 0; i < GS_MAX_CONN; i++) n += gsClients[i]->connects;
+    return n;
+}
+
+//print the results for a step
+void report(uint32_t offered, uint32_t connects)
+{
+    gsStats s;
+    GS->snapshot(s);
+    uint32_t secs = STEP_DURATION / 1000;
+    uint32_t dropped = s.sendBusy + s.sendShed + s.sendLost;
+
+    Serial << F("  samples/s offered ");
+    printTenths(offered * 10 / secs);
+    Serial << F(", delivered ");
+    printTenths(s.sendOK * 10 / secs);
+    Serial << F(", dropped ");
+    printTenths(offered ? dropped * 1000 / offered : 0);
+    Serial << F("% (busy ") << s.sendBusy << F(", shed ") << s.sendShed << F(", lost ") << s.sendLost << F(")\n");
+    Serial << F("  queue wait ms p50 ") << s.queueHist.percentile(50) << F(", p95 ") << s.queueHist.percentile(95)
+        << F(", p99 ") << s.queueHist.percentile(99) << F(", queue max ") << s.queueMax << endl;
+    Serial << F("  PUTs ") << s.httpOK + s.httpOther << F(", response ms p95 ") << s.respHist.percentile(95)
+        << F(", connections ") << connects << F(", stale retries ") << s.reconnects << F(", errors ") << s.connFail + s.recvTimeout + s.httpOther
+        << F(" (connect ") << s.connFail << F(", timeout ") << s.recvTimeout << F(", HTTP ") << s.httpOther << F(")\n");
+}
+
+//print a number of tenths with one decimal place
+void printTenths(uint32_t n)
+{
+    Serial << n / 10 << '.' << n % 10;
+}
@@ -0,0 +1,105 @@
+// Arduino GroveStreams Library
+// https://github.com/JChristensen/GroveStreams
+// Copyright (C) 2015-2024 by Jack Christensen and licensed under
+// GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+
+// Example sketch: GroveStreams Gateway for Linux
+// Forwards data to GroveStreams from a Linux host, e.g. a small
+// single-board computer that concentrates data from many sensor nodes.
+// Each line read from Serial (standard input on a host Arduino core)
+// is a component ID and its data, separated by a space, e.g.
+//   node1 &s=1&C=22.5
+// so that a radio receiver program can be piped into the sketch.
+// Sends are made over a pool of connections, using non-blocking
+// sockets and an epoll event loop.
+//
+// Build with an Arduino API core for Linux (e.g. EpoxyDuino, or the one
+// in extras/host, see CMakeLists.txt in the library folder), and compile
+// the library with GS_POSIX and GS_MAX_CONN defined, e.g.
+//   -DGS_POSIX -DGS_MAX_CONN=8
+//
+// v1.0  Developed with gcc 12 on Linux.
+
+#include <Streaming.h>          // https://github.com/janelia-arduino/Streaming
+#include <GroveStreams.h>       // https://github.com/JChristensen/GroveStreams
+#include <gsPosixClient.h>      // part of the GroveStreams library
+
+//installation-specific variables that WILL need to be changed
+PROGMEM const char gsApiKey[] = "Put *YOUR* GroveStreams API key here";
+
+//other global variables
+const char* gsServer = "grovestreams.com";
+const uint32_t BATCH_WINDOW(2000);          //ms to collect sends into a batch PUT
+const int POLL_MS(1);                       //ms to wait for socket activity each time through loop()
+const uint32_t STATS_INTERVAL(60000);       //ms between statistics reports
+const int32_t BAUD_RATE(115200);
+
+//object instantiations
+gsPosixLoop sockets;
+gsPosixClient* gsClients[GS_MAX_CONN];
+Client* gsPool[GS_MAX_CONN];
+GroveStreams* GS;
+
+void setup()
+{
+    Serial.begin(BAUD_RATE);
+    Serial << F( "\n" __FILE__ " " __DATE__ " " __TIME__ "\n" );
+    if ( !sockets.begin() )
+    {
+        Serial << millis() << F(" epoll fail\n");
+        exit(1);
+    }
+    for (uint8_t i = 0; i < GS_MAX_CONN; i++)
+    {
+        gsClients[i] = new gsPosixClient(sockets);
+        gsPool[i] = gsClients[i];
+    }
+    GS = new GroveStreams(gsPool, GS_MAX_CONN, gsServer, (const __FlashStringHelper*)gsApiKey, -1);
+    GS->logLevel = GS_LOG_ERROR;
+    GS->batchWindow = BATCH_WINDOW;
+    GS->keepAlive = true;
+    GS->timeStamp = true;
+    GS->begin();
+    Serial << millis() << F(" GroveStreams ") << GS->serverIP << F(", ") << GS_MAX_CONN << F(" connections\n");
+}
+
+void loop()
+{
+    sockets.poll(POLL_MS);          //wait for and handle socket activity
+    GS->run();                      //run the GroveStreams state machine
+
+    //read a line from the input, and queue it
+    static char line[128];
+    static uint8_t len;
+    while ( Serial.available() )
+    {
+        char c = Serial.read();
+        if ( c == '\n' )
+        {
+            line[len] = '\0';
+            len = 0;
+            char* data = strchr(line, ' ');
+            if ( data == NULL ) continue;
+            *data++ = '\0';
+            if ( GS->send(line, data) != SEND_ACCEPTED )
+            {
+                Serial << millis() << F(" Send FAIL ") << line << ' ' << data << endl;
+            }
+        }
+        else if ( len < sizeof(line) - 1 )
+        {
+            line[len++] = c;
+        }
+    }
+
+    //report statistics
+    static uint32_t msStats;
+    if ( millis() - msStats >= STATS_INTERVAL )
+    {
+        msStats += STATS_INTERVAL;
+        uint32_t sent = 0;
+        for (uint8_t i = 0; i < GS_MAX_CONN; i++) sent += gsClients[i]->bytesSent;
+        Serial << millis() << F(" sends ") << GS->sendSeq << F(", OK ") << GS->httpOK
+            << F(", busy ") << GS->sendBusy << F(", bytes ") << sent << endl;
+    }
+}
@@ -0,0 +1,221 @@
+// Arduino GroveStreams Library
+// https://github.com/JChristensen/GroveStreams
+// Copyright (C) 2015-2024 by Jack Christensen and licensed under
+// GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+
+// the Arduino core for the native build, see Arduino.h.
+
+#include <Arduino.h>
+#include <avr/wdt.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+HardwareSerial Serial;
+
+static uint64_t usNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t usStart = usNow();
+
+uint32_t millis()
+{
+    return (usNow() - usStart) / 1000;
+}
+
+uint32_t micros()
+{
+    return usNow() - usStart;
+}
+
+void delay(uint32_t ms)
+{
+    usleep(ms * 1000);
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    (void)pin;
+    (void)val;
+}
+
+// a noisy mid-scale reading
+int analogRead(uint8_t pin)
+{
+    (void)pin;
+    return 500 + rand() % 24;
+}
+
+long random(long max)
+{
+    return max > 0 ? rand() % max : 0;
+}
+
+long random(long min, long max)
+{
+    return min < max ? min + random(max - min) : min;
+}
+
+void randomSeed(unsigned long seed)
+{
+    srand(seed);
+}
+
+char* ultoa(unsigned long val, char* buf, int base)
+{
+    char tmp[33];
+    char* p = tmp;
+    do {
+        int d = val % base;
+        *p++ = d < 10 ? '0' + d : 'a' + d - 10;
+        val /= base;
+    } while (val);
+    char* q = buf;
+    while (p > tmp) *q++ = *--p;
+    *q = '\0';
+    return buf;
+}
+
+char* ltoa(long val, char* buf, int base)
+{
+    if (val < 0 && base == 10) {
+        buf[0] = '-';
+        ultoa(-(unsigned long)val, buf + 1, base);
+        return buf;
+    }
+    return ultoa(val, buf, base);
+}
+
+size_t Print::write(const uint8_t* buf, size_t size)
+{
+    size_t n = 0;
+    while (size--) n += write(*buf++);
+    return n;
+}
+
+size_t Print::print(long n, int base)
+{
+    char buf[34];
+    return write( ltoa(n, buf, base) );
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+    char buf[34];
+    return write( ultoa(n, buf, base) );
+}
+
+size_t Print::print(double n, int digits)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return write(buf);
+}
+
+size_t IPAddress::printTo(Print& p) const
+{
+    char buf[16];
+    sprintf(buf, "%u.%u.%u.%u", _a[0], _a[1], _a[2], _a[3]);
+    return p.write(buf);
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+    (void)baud;
+    setvbuf(stdout, NULL, _IOLBF, 0);
+}
+
+int HardwareSerial::available()
+{
+    if (_peeked >= 0) return 1;
+    int n = 0;
+    if ( ioctl(STDIN_FILENO, FIONREAD, &n) < 0 ) return 0;
+    return n;
+}
+
+int HardwareSerial::read()
+{
+    int c = peek();
+    _peeked = -1;
+    return c;
+}
+
+int HardwareSerial::peek()
+{
+    if (_peeked < 0 && available() > 0) {
+        uint8_t c;
+        if ( ::read(STDIN_FILENO, &c, 1) == 1 ) _peeked = c;
+    }
+    return _peeked;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    return fputc(c, stdout) == EOF ? 0 : 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t size)
+{
+    return fwrite(buf, 1, size, stdout);
+}
+
+void HardwareSerial::flush()
+{
+    fflush(stdout);
+}
+
+// the watchdog, SIGALRM ends the program
+static const uint16_t wdtMs[] = { 15, 30, 60, 120, 250, 500, 1000, 2000, 4000, 8000 };
+static uint16_t wdtTimeout;
+
+static void wdtExpired(int)
+{
+    static const char msg[] = "\nWatchdog reset\n";
+    fflush(stdout);
+    if ( ::write(STDERR_FILENO, msg, sizeof(msg) - 1) ) {}
+    _exit(2);
+}
+
+void wdt_reset()
+{
+    if (wdtTimeout == 0) return;
+    struct itimerval t;
+    memset(&t, 0, sizeof(t));
+    t.it_value.tv_sec = wdtTimeout / 1000;
+    t.it_value.tv_usec = wdtTimeout % 1000 * 1000L;
+    setitimer(ITIMER_REAL, &t, NULL);
+}
+
+void wdt_enable(unsigned char timeout)
+{
+    signal(SIGALRM, wdtExpired);
+    wdtTimeout = wdtMs[timeout < sizeof(wdtMs) / sizeof(wdtMs[0]) ? timeout : WDTO_8S];
+    wdt_reset();
+}
+
+void wdt_disable()
+{
+    wdtTimeout = 0;
+    struct itimerval t;
+    memset(&t, 0, sizeof(t));
+    setitimer(ITIMER_REAL, &t, NULL);
+}
+
+int main()
+{
+    signal(SIGPIPE, SIG_IGN);       // a closed connection shows up as a write error
+    setup();
+    for (;;) loop();
+}
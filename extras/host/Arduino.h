@@ -0,0 +1,144 @@
+// Arduino GroveStreams Library
+// https://github.com/JChristensen/GroveStreams
+// Copyright (C) 2015-2024 by Jack Christensen and licensed under
+// GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+
+// minimal Arduino API for building the library and its examples natively
+// on Linux, see CMakeLists.txt. only what the library and the examples use
+// is provided. millis() and micros() are real time, Serial is standard
+// output and input, and there is no flash, so the pgmspace functions are
+// the ordinary ones.
+
+#ifndef ARDUINO_H_INCLUDED
+#define ARDUINO_H_INCLUDED
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// timing, I/O pins and random numbers
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int analogRead(uint8_t pin);
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+char* ultoa(unsigned long val, char* buf, int base);
+char* ltoa(long val, char* buf, int base);
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define A0 14
+
+// there is no separate flash memory
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) ( (const __FlashStringHelper*)(s) )
+typedef const char* PGM_P;
+#define pgm_read_byte(p) ( *(const uint8_t*)(p) )
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcasecmp_P strcasecmp
+#define strncasecmp_P strncasecmp
+#define strstr_P strstr
+#define memcpy_P memcpy
+#define sprintf_P sprintf
+#define snprintf_P snprintf
+
+class __FlashStringHelper;
+
+#define DEC 10
+#define HEX 16
+
+class Print;
+
+class Printable
+{
+public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print& p) const = 0;
+};
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buf, size_t size);
+    size_t write(const char* s) { return write( (const uint8_t*)s, strlen(s) ); }
+    size_t write(const char* buf, size_t size) { return write( (const uint8_t*)buf, size ); }
+    virtual void flush() {}
+
+    size_t print(const __FlashStringHelper* s) { return write( (const char*)s ); }
+    size_t print(const char* s) { return write(s); }
+    size_t print(char c) { return write( (uint8_t)c ); }
+    size_t print(unsigned char n, int base = DEC) { return print( (unsigned long)n, base ); }
+    size_t print(int n, int base = DEC) { return print( (long)n, base ); }
+    size_t print(unsigned int n, int base = DEC) { return print( (unsigned long)n, base ); }
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(double n, int digits = 2);
+    size_t print(const Printable& x) { return x.printTo(*this); }
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(const T& x) { return print(x) + println(); }
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+class IPAddress : public Printable
+{
+public:
+    IPAddress() : IPAddress(0, 0, 0, 0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) { _a[0] = a; _a[1] = b; _a[2] = c; _a[3] = d; }
+    IPAddress(const uint8_t* a) { memcpy(_a, a, 4); }
+    uint8_t operator[](int i) const { return _a[i]; }
+    uint8_t& operator[](int i) { return _a[i]; }
+    bool operator==(const IPAddress& x) const { return memcmp(_a, x._a, 4) == 0; }
+    size_t printTo(Print& p) const;
+
+private:
+    uint8_t _a[4];
+};
+
+// standard output, and standard input without blocking
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long baud);
+    int available();
+    int read();
+    int peek();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t* buf, size_t size);
+    void flush();
+    operator bool() { return true; }
+    using Print::write;
+
+private:
+    int _peeked {-1};
+};
+
+extern HardwareSerial Serial;
+
+// the sketch
+void setup();
+void loop();
+
+#endif
@@ -0,0 +1,23 @@
+// Arduino GroveStreams Library
+// https://github.com/JChristensen/GroveStreams
+// Copyright (C) 2015-2024 by Jack Christensen and licensed under
+// GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+
+// the Ethernet library's DNS client, for the native build. names are looked
+// up with getaddrinfo(), unless the GS_HOST_SERVER environment variable
+// gives an address to use for every name, e.g. GS_HOST_SERVER=127.0.0.1 to
+// send everything to extras/host/gsFakeServer.py.
+
+#ifndef DNS_H_INCLUDED
+#define DNS_H_INCLUDED
+
+#include <Arduino.h>
+
+class DNSClient
+{
+public:
+    void begin(const IPAddress& server) { (void)server; }
+    int getHostByName(const char* host, IPAddress& addr);
+};
+
+#endif
@@ -0,0 +1,131 @@
+// Arduino GroveStreams Library
+// https://github.com/JChristensen/GroveStreams
+// Copyright (C) 2015-2024 by Jack Christensen and licensed under
+// GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+
+// the Ethernet library for the native build, see Ethernet.h.
+
+#include <Ethernet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+EthernetClass Ethernet;
+
+int DNSClient::getHostByName(const char* host, IPAddress& addr)
+{
+    const char* server = getenv("GS_HOST_SERVER");
+    struct addrinfo hints;
+    struct addrinfo* res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if ( getaddrinfo(server ? server : host, NULL, &hints, &res) != 0 ) return 0;
+    const uint8_t* a = (const uint8_t*)&( (struct sockaddr_in*)res->ai_addr )->sin_addr.s_addr;
+    addr = IPAddress(a);
+    freeaddrinfo(res);
+    return 1;
+}
+
+int EthernetClient::connect(IPAddress ip, uint16_t port)
+{
+    stop();
+    _fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (_fd < 0) return 0;
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    for (uint8_t i = 0; i < 4; i++) ( (uint8_t*)&sa.sin_addr.s_addr )[i] = ip[i];
+    if ( ::connect(_fd, (struct sockaddr*)&sa, sizeof(sa)) < 0 ) {
+        stop();
+        return 0;
+    }
+    int one = 1;
+    setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return 1;
+}
+
+int EthernetClient::connect(const char* host, uint16_t port)
+{
+    DNSClient dns;
+    IPAddress ip;
+    if ( !dns.getHostByName(host, ip) ) return 0;
+    return connect(ip, port);
+}
+
+size_t EthernetClient::write(const uint8_t* buf, size_t size)
+{
+    if (_fd < 0) return 0;
+    size_t n = 0;
+    while (n < size) {
+        ssize_t w = send(_fd, buf + n, size - n, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) break;
+        n += w;
+    }
+    return n;
+}
+
+int EthernetClient::available()
+{
+    if (_fd < 0) return 0;
+    int n = 0;
+    if ( ioctl(_fd, FIONREAD, &n) < 0 ) return 0;
+    if (n == 0 && !_eof) {
+        uint8_t c;
+        if ( recv(_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0 ) _eof = true;
+    }
+    return n + (_peeked >= 0);
+}
+
+int EthernetClient::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int EthernetClient::read(uint8_t* buf, size_t size)
+{
+    if (_fd < 0 || size == 0) return -1;
+    size_t n = 0;
+    if (_peeked >= 0) {
+        buf[n++] = _peeked;
+        _peeked = -1;
+    }
+    if (n < size) {
+        ssize_t r = recv(_fd, buf + n, size - n, MSG_DONTWAIT);
+        if (r == 0) _eof = true;
+        if (r > 0) n += r;
+    }
+    return n > 0 ? (int)n : -1;
+}
+
+int EthernetClient::peek()
+{
+    if (_peeked < 0) {
+        uint8_t c;
+        if ( _fd >= 0 && recv(_fd, &c, 1, MSG_DONTWAIT) == 1 ) _peeked = c;
+    }
+    return _peeked;
+}
+
+void EthernetClient::stop()
+{
+    if (_fd >= 0) close(_fd);
+    _fd = -1;
+    _peeked = -1;
+    _eof = false;
+}
+
+// like the W5100, still connected after the server closes while there is
+// data left to read
+uint8_t EthernetClient::connected()
+{
+    if (_fd < 0) return 0;
+    return available() > 0 || !_eof;
+}
@@ -0,0 +1,54 @@
+// Arduino GroveStreams Library
+// https://github.com/JChristensen/GroveStreams
+// Copyright (C) 2015-2024 by Jack Christensen and licensed under
+// GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+
+// the Ethernet library, for the native build. EthernetClient uses an
+// ordinary TCP socket; like the W5100 it connects in the foreground and
+// reads without blocking. Ethernet.begin() always succeeds, as DHCP would.
+
+#ifndef ETHERNET_H_INCLUDED
+#define ETHERNET_H_INCLUDED
+
+#include <Arduino.h>
+#include <Client.h>
+#include <Dns.h>
+
+class EthernetClass
+{
+public:
+    int begin(uint8_t* mac) { (void)mac; return 1; }
+    void begin(uint8_t* mac, IPAddress ip) { (void)mac; (void)ip; }
+    int maintain() { return 0; }
+    IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+    IPAddress dnsServerIP() { return IPAddress(127, 0, 0, 53); }
+};
+
+extern EthernetClass Ethernet;
+
+class EthernetClient : public Client
+{
+public:
+    EthernetClient() : _fd(-1), _peeked(-1), _eof(false) {}
+    ~EthernetClient() { stop(); }
+    int connect(IPAddress ip, uint16_t port);
+    int connect(const char* host, uint16_t port);
+    size_t write(uint8_t b) { return write(&b, 1); }
+    size_t write(const uint8_t* buf, size_t size);
+    int available();
+    int read();
+    int read(uint8_t* buf, size_t size);
+    int peek();
+    void flush() {}
+    void stop();
+    uint8_t connected();
+    operator bool() { return _fd >= 0; }
+    using Print::write;
+
+private:
+    int _fd;
+    int _peeked;        // a byte read by peek(), or -1
+    bool _eof;          // the server closed the connection
+};
+
+#endif
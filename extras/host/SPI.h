@@ -0,0 +1,14 @@
+// Arduino GroveStreams Library
+// https://github.com/JChristensen/GroveStreams
+// Copyright (C) 2015-2024 by Jack Christensen and licensed under
+// GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+
+// nothing is needed from SPI for the native build, this only satisfies the
+// examples' #include.
+
+#ifndef SPI_H_INCLUDED
+#define SPI_H_INCLUDED
+
+#include <Arduino.h>
+
+#endif
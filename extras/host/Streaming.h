@@ -0,0 +1,20 @@
+// Arduino GroveStreams Library
+// https://github.com/JChristensen/GroveStreams
+// Copyright (C) 2015-2024 by Jack Christensen and licensed under
+// GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+
+// the parts of the Streaming library (https://github.com/janelia-arduino/Streaming)
+// that the library and the examples use, for the native build.
+
+#ifndef STREAMING_H_INCLUDED
+#define STREAMING_H_INCLUDED
+
+#include <Arduino.h>
+
+template <class T> inline Print& operator<<(Print& obj, const T& arg) { obj.print(arg); return obj; }
+
+enum _EndLineCode { endl };
+
+inline Print& operator<<(Print& obj, _EndLineCode) { obj.println(); return obj; }
+
+#endif
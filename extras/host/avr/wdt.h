@@ -0,0 +1,28 @@
+// Arduino GroveStreams Library
+// https://github.com/JChristensen/GroveStreams
+// Copyright (C) 2015-2024 by Jack Christensen and licensed under
+// GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+
+// watchdog timer for the native build. wdt_enable() starts a timer that,
+// unless wdt_reset() is called first, ends the program as a watchdog reset
+// of the mcu would restart it.
+
+#ifndef WDT_H_INCLUDED
+#define WDT_H_INCLUDED
+
+#define WDTO_15MS 0
+#define WDTO_30MS 1
+#define WDTO_60MS 2
+#define WDTO_120MS 3
+#define WDTO_250MS 4
+#define WDTO_500MS 5
+#define WDTO_1S 6
+#define WDTO_2S 7
+#define WDTO_4S 8
+#define WDTO_8S 9
+
+void wdt_enable(unsigned char timeout);
+void wdt_reset();
+void wdt_disable();
+
+#endif
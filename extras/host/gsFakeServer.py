@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+# Arduino GroveStreams Library
+# https://github.com/JChristensen/GroveStreams
+# Copyright (C) 2015-2024 by Jack Christensen and licensed under
+# GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+
+# a stand-in for the GroveStreams server, for testing the native build
+# (see "Native Linux build" in the README). accepts PUTs to /api/feed, both
+# the query string form and batch JSON bodies, and answers
+# "HTTP/1.1 200 OK" with a Date header, honoring keep-alive. the latency of
+# the answers can be set, and a fraction of requests can be made to fail
+# with an HTTP error, get no answer at all (a timeout), or have the
+# connection closed without an answer. a count of requests and samples is
+# printed every few seconds.
+#   python3 extras/host/gsFakeServer.py --latency 200 --error-rate 0.05
+
+import argparse
+import email.utils
+import json
+import random
+import socketserver
+import threading
+import time
+import urllib.parse
+
+parser = argparse.ArgumentParser(description='stand-in GroveStreams server')
+parser.add_argument('--port', type=int, default=8080, help='TCP port (default 8080)')
+parser.add_argument('--latency', type=float, default=0, help='ms to wait before answering')
+parser.add_argument('--jitter', type=float, default=0, help='ms of random extra latency, up to')
+parser.add_argument('--error-rate', type=float, default=0, help='fraction of requests answered with --status')
+parser.add_argument('--status', type=int, default=503, help='HTTP status for errors (default 503)')
+parser.add_argument('--retry-after', type=int, default=0, help='seconds for a Retry-After header on errors, 0 for none')
+parser.add_argument('--timeout-rate', type=float, default=0, help='fraction of requests never answered')
+parser.add_argument('--close-rate', type=float, default=0, help='fraction of requests where the connection is closed without an answer')
+parser.add_argument('--put-limit', type=int, default=0, help='PUTs allowed per 120 s, more get 429, 0 for no limit')
+parser.add_argument('--clock-offset', type=float, default=0, help='seconds to add to the Date header')
+parser.add_argument('--report', type=float, default=10, help='seconds between statistics reports, 0 for none')
+parser.add_argument('--verbose', action='store_true', help='print each request')
+args = parser.parse_args()
+
+lock = threading.Lock()
+stats = dict(conns=0, requests=0, samples=0, ok=0, errors=0, limited=0, timeouts=0, closes=0, bad=0)
+putTimes = []
+
+
+def count(key, n=1):
+    with lock:
+        stats[key] += n
+
+
+def samples(target, body):
+    """number of samples in a request: one per feed item in a batch body,
+    otherwise one per name=value pair other than compId, api_key and time"""
+    if body:
+        try:
+            return len(json.loads(body))
+        except (ValueError, TypeError):
+            return 0
+    q = urllib.parse.urlsplit(target).query
+    pairs = urllib.parse.parse_qsl(q, keep_blank_values=True)
+    return len([k for k, v in pairs if k not in ('compId', 'api_key', 'time')])
+
+
+def overLimit():
+    if args.put_limit <= 0:
+        return False
+    now = time.monotonic()
+    with lock:
+        while putTimes and now - putTimes[0] >= 120:
+            putTimes.pop(0)
+        if len(putTimes) >= args.put_limit:
+            return True
+        putTimes.append(now)
+        return False
+
+
+class Handler(socketserver.StreamRequestHandler):
+
+    def handle(self):
+        count('conns')
+        while True:
+            line = self.rfile.readline(4096)
+            if not line:
+                return
+            # the target is not escaped, e.g. the example sketches' API key has spaces
+            method, _, rest = line.decode('latin-1').strip().partition(' ')
+            target = rest.rpartition(' ')[0]
+            headers = {}
+            while True:
+                h = self.rfile.readline(4096)
+                if not h or h in (b'\r\n', b'\n'):
+                    break
+                k, _, v = h.decode('latin-1').partition(':')
+                headers[k.strip().lower()] = v.strip()
+            body = b''
+            n = int(headers.get('content-length', '0') or 0)
+            if n > 0:
+                body = self.rfile.read(n)
+            count('requests')
+            if args.verbose:
+                print(line.decode('latin-1').strip(), len(body))
+            keepAlive = headers.get('connection', '').lower() == 'keep-alive'
+
+            if method != 'PUT' or not target.startswith('/api/feed'):
+                count('bad')
+                self.answer(404, False)
+                return
+            if random.random() < args.close_rate:
+                count('closes')
+                return
+            if random.random() < args.timeout_rate:
+                count('timeouts')
+                while self.rfile.read(1):      # until the client gives up
+                    pass
+                return
+            delay = args.latency + random.random() * args.jitter
+            if delay > 0:
+                time.sleep(delay / 1000)
+            if overLimit():
+                count('limited')
+                self.answer(429, keepAlive, args.retry_after)
+            elif random.random() < args.error_rate:
+                count('errors')
+                self.answer(args.status, keepAlive, args.retry_after)
+            else:
+                count('ok')
+                count('samples', samples(target, body))
+                self.answer(200, keepAlive)
+            if not keepAlive:
+                return
+
+    def answer(self, status, keepAlive, retryAfter=0):
+        reason = {200: 'OK', 404: 'Not Found', 429: 'Too Many Requests', 503: 'Service Unavailable'}.get(status, 'Error')
+        date = email.utils.formatdate(time.time() + args.clock_offset, usegmt=True)
+        msg = 'HTTP/1.1 %d %s\r\nDate: %s\r\nContent-Length: 0\r\n' % (status, reason, date)
+        if retryAfter > 0:
+            msg += 'Retry-After: %d\r\n' % retryAfter
+        msg += 'Connection: %s\r\n\r\n' % ('keep-alive' if keepAlive else 'close')
+        self.wfile.write(msg.encode('latin-1'))
+
+
+class Server(socketserver.ThreadingTCPServer):
+    allow_reuse_address = True
+    daemon_threads = True
+    request_queue_size = 64
+
+
+def report():
+    last = dict(stats)
+    while True:
+        time.sleep(args.report)
+        with lock:
+            now = dict(stats)
+        print('%s requests %d (%.1f/s), samples %d (%.1f/s), OK %d, errors %d, 429 %d, timeouts %d, closes %d, connections %d'
+              % (time.strftime('%H:%M:%S'), now['requests'], (now['requests'] - last['requests']) / args.report,
+                 now['samples'], (now['samples'] - last['samples']) / args.report, now['ok'], now['errors'],
+                 now['limited'], now['timeouts'], now['closes'], now['conns']), flush=True)
+        last = now
+
+
+if __name__ == '__main__':
+    server = Server(('', args.port), Handler)
+    print('gsFakeServer listening on port %d' % args.port, flush=True)
+    if args.report > 0:
+        threading.Thread(target=report, daemon=True).start()
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,315 @@
+// Arduino GroveStreams Library
+// https://github.com/JChristensen/GroveStreams
+// Copyright (C) 2015-2024 by Jack Christensen and licensed under
+// GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+
+// tests of the queue, spill and replay paths for the native build, run by
+// ctest (see CMakeLists.txt). the server is a scripted Client that answers
+// each complete request at once, or refuses to connect while it is down,
+// and the store is kept in RAM. the exit status is the number of failures.
+
+#include <Arduino.h>
+#include <Client.h>
+#include <Streaming.h>
+#include <GroveStreams.h>
+#include <gsFileStore.h>
+#include <deque>
+#include <string>
+
+// a server that can be taken down, and answers every request with status
+class gsMockClient : public Client
+{
+public:
+    int connect(IPAddress, uint16_t) { if (!up) return 0; _open = true; _req.clear(); return 1; }
+    int connect(const char*, uint16_t port) { return connect(IPAddress(), port); }
+    size_t write(uint8_t b) { return write(&b, 1); }
+    size_t write(const uint8_t* buf, size_t size);
+    int available() { return _resp.size() - _rd; }
+    int read() { return available() > 0 ? (uint8_t)_resp[_rd++] : -1; }
+    int read(uint8_t* buf, size_t size);
+    int peek() { return available() > 0 ? (uint8_t)_resp[_rd] : -1; }
+    void flush() {}
+    void stop() { _open = false; _resp.clear(); _rd = 0; }
+    uint8_t connected() { return _open || available() > 0; }
+    operator bool() { return _open; }
+
+    bool up {true};         // connections are accepted
+    int status {200};       // status of the answers
+    const char* headers {""};   // more header lines for the answers, each ending in CRLF
+    bool length {true};     // give a Content-Length, else the body ends when the connection closes
+    uint32_t requests {0};  // number of requests answered
+
+private:
+    bool _open {false};
+    std::string _req;
+    std::string _resp;
+    size_t _rd {0};
+};
+
+// answer the request once its headers and body have arrived
+size_t gsMockClient::write(const uint8_t* buf, size_t size)
+{
+    if (!_open) return 0;
+    _req.append( (const char*)buf, size );
+    size_t end = _req.find("\r\n\r\n");
+    if (end == std::string::npos) return size;
+    size_t body = 0;
+    size_t cl = _req.find("Content-Length: ");
+    if (cl != std::string::npos && cl < end) body = atoi( _req.c_str() + cl + 16 );
+    if (_req.size() < end + 4 + body) return size;
+    _req.clear();
+    ++requests;
+    char resp[160];
+    snprintf(resp, sizeof(resp), "HTTP/1.1 %d X\r\n%s%sConnection: close\r\n\r\n%s", status, headers,
+        length ? "Content-Length: 0\r\n" : "", length ? "" : "OK");
+    _resp = resp;
+    _rd = 0;
+    _open = false;          // the server closes the connection after answering
+    return size;
+}
+
+int gsMockClient::read(uint8_t* buf, size_t size)
+{
+    int n = 0;
+    while (n < (int)size && available() > 0) buf[n++] = read();
+    return n > 0 ? n : -1;
+}
+
+// a store in RAM
+class gsRamStore : public gsStore
+{
+public:
+    bool append(const char* compID, const char* data, const char* more);
+    uint16_t peek(char* buf, uint16_t size);
+    void pop() { if (!_rec.empty()) _rec.pop_front(); }
+    uint32_t count() { return _rec.size(); }
+
+    uint32_t capacity {1000};   // most records that can be stored
+
+private:
+    std::deque<std::string> _rec;
+};
+
+bool gsRamStore::append(const char* compID, const char* data, const char* more)
+{
+    if (_rec.size() >= capacity) return false;
+    std::string r(compID);
+    r += '\0';
+    r += data;
+    r += more;
+    r += '\0';
+    _rec.push_back(r);
+    return true;
+}
+
+uint16_t gsRamStore::peek(char* buf, uint16_t size)
+{
+    if (_rec.empty()) return 0;
+    uint16_t len = _rec.front().size();
+    if (len <= size) memcpy(buf, _rec.front().data(), len);
+    return len;
+}
+
+PROGMEM const char gsApiKey[] = "test";
+int failures;
+
+#define CHECK(cond) check( (cond), #cond, __LINE__ )
+
+void check(bool ok, const char* what, int line)
+{
+    if (!ok) {
+        Serial << F("  FAIL line ") << line << F(": ") << what << endl;
+        ++failures;
+    }
+}
+
+// call run() until cond is true, or ms have passed
+#define RUN_UNTIL(gs, cond, ms) do { uint32_t t0 = millis(); \
+    while ( !(cond) && millis() - t0 < (ms) ) { (gs).run(); delay(1); } } while (0)
+
+// with a store, bulk sends are moved to it to make room for new ones, so
+// none are rejected while the network is down
+void testSpillMakesRoom()
+{
+    Serial << F("testSpillMakesRoom\n");
+    gsMockClient client;
+    gsRamStore store;
+    GroveStreams gs(client, "127.0.0.1", (const __FlashStringHelper*)gsApiKey);
+    gs.logLevel = GS_LOG_NONE;
+    gs.store = &store;
+    gs.begin();
+    client.up = false;
+
+    const char* data = "&s=12345&C=21.50&F=70.70&rss=-65&v=3.3";   // 38 characters
+    uint8_t busy = 0;
+    for (uint8_t i = 0; i < 20; i++) {
+        if ( gs.send("c01", data) != SEND_ACCEPTED ) ++busy;
+    }
+    CHECK(busy == 0);
+    CHECK(gs.sendBusy == 0);
+    CHECK(gs.queued + gs.stored == 20);
+
+    // in place, one datastream at a time
+    for (uint8_t i = 0; i < 10; i++) {
+        gs.sendBegin("c02");
+        gs.addInt("s", i);
+        gs.addFixed("C", 2150, 2);
+        gs.addString("msg", "door open");
+        if ( gs.sendEnd() != SEND_ACCEPTED ) ++busy;
+    }
+    CHECK(busy == 0);
+    CHECK(gs.queued + gs.stored == 30);
+}
+
+// without a store, a full queue rejects sends
+void testQueueFull()
+{
+    Serial << F("testQueueFull\n");
+    gsMockClient client;
+    GroveStreams gs(client, "127.0.0.1", (const __FlashStringHelper*)gsApiKey);
+    gs.logLevel = GS_LOG_NONE;
+    gs.begin();
+
+    uint8_t accepted = 0;
+    for (uint8_t i = 0; i < 20; i++) {
+        if ( gs.send("c01", "&s=1&C=21.5") == SEND_ACCEPTED ) ++accepted;
+    }
+    CHECK(accepted == gs.queued);
+    CHECK(gs.sendBusy == 20u - accepted);
+    CHECK(gs.sendBusy > 0);
+
+    // and everything accepted is sent
+    RUN_UNTIL(gs, gs.queued == 0, 2000);
+    CHECK(gs.queued == 0);
+    CHECK(gs.sendOK == accepted);
+    CHECK(client.requests == accepted);
+}
+
+// sends that fail are stored, and replayed once the server is back, with no
+// new sends needed to close the circuit breaker
+void testReplayDrains()
+{
+    Serial << F("testReplayDrains\n");
+    gsMockClient client;
+    gsRamStore store;
+    GroveStreams gs(client, "127.0.0.1", (const __FlashStringHelper*)gsApiKey);
+    gs.logLevel = GS_LOG_NONE;
+    gs.store = &store;
+    gs.replayInterval = 10;
+    gs.backoffMin = 50;
+    gs.backoffMax = 100;
+    gs.breakerThreshold = 2;
+    gs.putInterval = 0;
+    gs.begin();
+
+    client.up = false;
+    for (uint8_t i = 0; i < 4; i++) gs.send("c01", "&s=1&C=21.5");
+    RUN_UNTIL(gs, gs.breaker == GS_BREAKER_OPEN && gs.queued == 0, 3000);
+    CHECK(gs.breaker == GS_BREAKER_OPEN);
+    CHECK(gs.queued == 0);
+    CHECK(store.count() == 4);
+    CHECK(gs.sendLost == 0);
+
+    client.up = true;
+    RUN_UNTIL(gs, store.count() == 0 && gs.queued == 0, 3000);
+    CHECK(store.count() == 0);
+    CHECK(gs.breaker == GS_BREAKER_CLOSED);
+    CHECK(gs.replayed >= 4);       // and more if a trial failed while the server was down
+    CHECK(gs.sendOK == 4);
+}
+
+// a send that fails when the store is full is counted as lost
+void testStoreFullLost()
+{
+    Serial << F("testStoreFullLost\n");
+    gsMockClient client;
+    gsRamStore store;
+    GroveStreams gs(client, "127.0.0.1", (const __FlashStringHelper*)gsApiKey);
+    gs.logLevel = GS_LOG_NONE;
+    gs.store = &store;
+    store.capacity = 1;
+    gs.begin();
+
+    client.status = 503;
+    gs.send("c01", "&s=1");
+    RUN_UNTIL(gs, gs.queued == 0, 2000);
+    gs.send("c01", "&s=2");
+    RUN_UNTIL(gs, gs.queued == 0, 2000);
+    CHECK(store.count() == 1);
+    CHECK(gs.stored == 1);
+    CHECK(gs.sendLost == 1);
+}
+
+// the Date and Retry-After headers are used even when the body has no
+// length, and only ends when the server closes the connection
+void testCloseDelimited()
+{
+    Serial << F("testCloseDelimited\n");
+    gsMockClient client;
+    GroveStreams gs(client, "127.0.0.1", (const __FlashStringHelper*)gsApiKey);
+    gs.logLevel = GS_LOG_NONE;
+    gs.begin();
+
+    client.length = false;
+    client.headers = "Date: Fri, 16 Oct 2026 12:00:00 GMT\r\n";
+    gs.send("c01", "&s=1");
+    RUN_UNTIL(gs, gs.queued == 0, 2000);
+    CHECK(gs.httpOK == 1);
+    CHECK(gs.now() - 1792152000UL <= 2);
+
+    client.status = 503;
+    client.headers = "Retry-After: 30\r\n";
+    gs.send("c01", "&s=2");
+    RUN_UNTIL(gs, gs.queued == 0, 2000);
+    CHECK(gs.httpOther == 1);
+    CHECK(gs.backoff == 30000);
+}
+
+// a file store starts over when its data file is gone, whatever the
+// position file says, and drains to an empty file
+void testFileStoreRestart()
+{
+    Serial << F("testFileStoreRestart\n");
+    const char* dataPath = "gsTest.dat";
+    const char* posPath = "gsTest.pos";
+    remove(dataPath);
+    FILE* f = fopen(posPath, "w");
+    fprintf(f, "100\n");
+    fclose(f);
+
+    gsFileStore store(dataPath, posPath);
+    store.begin();
+    CHECK(store.count() == 0);
+    CHECK( store.append("c01", "&s=1", "") );
+    CHECK( store.append("c01", "&s=2", "") );
+    char buf[32] = "";
+    CHECK(store.peek(buf, sizeof(buf)) == 9);      // "c01\0&s=1\0"
+    CHECK(strcmp(buf + 4, "&s=1") == 0);
+    store.pop();
+    store.pop();
+    CHECK(store.count() == 0);
+
+    gsFileStore again(dataPath, posPath);
+    again.begin();
+    CHECK(again.count() == 0);
+    CHECK(again.peek(buf, sizeof(buf)) == 0);
+    remove(dataPath);
+    remove(posPath);
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    testSpillMakesRoom();
+    testQueueFull();
+    testReplayDrains();
+    testStoreFullLost();
+    testCloseDelimited();
+    testFileStoreRestart();
+    Serial << (failures == 0 ? F("all tests passed\n") : F("tests failed\n"));
+    exit(failures);
+}
+
+void loop()
+{
+}
@@ -4,188 +4,1375 @@
 // GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
 
 #include <GroveStreams.h>
+#if defined(GS_POSIX)
+#include <netdb.h>
+#include <netinet/in.h>
+#endif
 
-// Initialize GroveStreams
+// trace logging. levels above GS_LOG_LEVEL are not compiled at all,
+// the logLevel member limits the output further at run time.
+#if GS_LOG_LEVEL >= GS_LOG_ERROR
+#define GS_ERROR(x) do { if (logLevel >= GS_LOG_ERROR) Serial << millis() << x; } while (0)
+#else
+#define GS_ERROR(x) do { } while (0)
+#endif
+#if GS_LOG_LEVEL >= GS_LOG_INFO
+#define GS_INFO(x) do { if (logLevel >= GS_LOG_INFO) Serial << millis() << x; } while (0)
+#else
+#define GS_INFO(x) do { } while (0)
+#endif
+
+// latency histograms
+#if GS_HISTOGRAMS
+#define GS_HIST(h, ms) (h).add(ms)
+#else
+#define GS_HIST(h, ms) do { } while (0)
+#endif
+
+// binary event log
+#if GS_EVENTS > 0
+#define GS_EVENT(code, arg) _event(code, arg)
+#else
+#define GS_EVENT(code, arg) do { } while (0)
+#endif
+
+// counts, and optionally writes to a packet, the pieces of a batch PUT body
+class batchWriter
+{
+public:
+    batchWriter(ethernetPacket* packet, uint16_t from = 0, uint16_t to = 0xFFFF)
+        : n(0), first(true), _packet(packet), _from(from), _to(to) {}
+    void put(const __FlashStringHelper* f);
+    void put(char c) { if (_packet && n >= _from && n < _to) _packet->putChar(c); ++n; }
+    void putString(const char* s, const char* end);
+    void putValue(const char* s, const char* end);
+
+    uint16_t n;     // number of characters
+    bool first;     // true if no comma is needed before the next item
+
+private:
+    ethernetPacket* _packet;
+    uint16_t _from;     // only characters in [_from, _to) are written to the packet
+    uint16_t _to;
+};
+
+char GroveStreams::_arena[PKTSIZE];
+
+// Initialize GroveStreams. if the server's address cannot be looked up now,
+// run() keeps trying, and sends are held in the queue until it succeeds.
 void GroveStreams::begin()
 {
-    int ret = dnsLookup(_serverName, serverIP);
+    _apiKeyLen = strlen_P( (PGM_P)_apiKey );
+    for (uint8_t i = 0; i < PUT_BURST; i++) _msPut[i] = millis() - PUT_BURST * putInterval;
+    _resolve();
+}
+
+// look up the server's address, and schedule the next lookup. if the lookup
+// fails, the last known good address is kept.
+void GroveStreams::_resolve()
+{
+    IPAddress addr;
+    uint32_t msStart = millis();
+    int ret = dnsLookup(_serverName, addr);
+    _msResolved = millis();
+    dnsTime = _msResolved - msStart;
+
     if (ret == 1) {
-        Serial << millis() << F(" GroveStreams ") << serverIP << endl;
+        if ( !_dnsValid || !(addr == serverIP) ) {
+            serverIP = addr;
+            _buildHeaders();
+            GS_INFO( F(" GroveStreams ") << serverIP << endl );
+            GS_EVENT(EV_DNS_OK, dnsTime);
+        }
+        _dnsValid = true;
+        _dnsInterval = dnsRefresh;
     }
     else {
-        Serial << millis() << F(" GS DNS lookup fail, ret=") << ret << endl;
-        if (!bypassMode) mcuReset();
+        ++dnsFail;
+        _dnsInterval = DNS_RETRY;
+        GS_ERROR( F(" GS DNS lookup fail, ret=") << ret << endl );
+        GS_EVENT(EV_DNS_FAIL, ret);
     }
-    ipToText(_localIP, Ethernet.localIP());
-    ipToText(_groveStreamsIP, serverIP);
 }
 
-enum gsState_t
+// create a GroveStreams object with a pool of clients, e.g. one for each of
+// the Ethernet chip's sockets, so that several PUTs can be in progress at
+// once. at most GS_MAX_CONN clients are used.
+GroveStreams::GroveStreams(Client* const* clients, uint8_t nClients, const char* server, const __FlashStringHelper* apiKey, int ledPin)
+    : _serverName(server), _apiKey(apiKey), _ledPin(ledPin)
 {
-    GS_WAIT, GS_SEND, GS_RECV, GS_DISCONNECT
-};
-gsState_t GS_STATE;
+    _nConn = nClients < GS_MAX_CONN ? nClients : GS_MAX_CONN;
+    for (uint8_t i = 0; i < _nConn; i++) {
+        _conn[i].client = clients[i];
+        _conn[i].id = i + 1;
+    }
+}
 
-// GroveStreams state machine
+// GroveStreams state machine. each call advances every connection in the
+// pool by one step, but returns as soon as one of them has a status to
+// report, so that none is lost. the next call starts with the following
+// connection. a circuit breaker transition is reported by a call of its own.
 ethernetStatus_t GroveStreams::run()
 {
     ethernetStatus_t ret = NO_STATUS;
-    const char httpOKText[] = "HTTP/1.1 200";
-    static char statusBuf[sizeof(httpOKText)];
+    uint32_t usStart = micros();
 
-    if ( nError >= MAX_ERROR ) {
-        Serial << millis() << F(" too many network errors\n");
-        mcuReset();
+    if (_breakerStatus != NO_STATUS) {
+        ret = _breakerStatus;
+        _breakerStatus = NO_STATUS;
     }
+    else {
+        // reset only as a last resort, if the server has been unreachable for
+        // a long time. while the breaker is half open, no trial has failed yet.
+        if ( breaker == GS_BREAKER_OPEN && resetAfter > 0 && millis() - _msOpened >= resetAfter ) {
+            GS_ERROR( F(" circuit breaker open too long\n") );
+            if (store != NULL) _spillAll();
+            mcuReset();
+        }
+
+        // refresh the server's address when it is due, but only when that will not
+        // hold up a send, unless there is no address at all.
+        if ( _idle() && millis() - _msResolved >= _dnsInterval
+            && (!_dnsValid || _queue.count() == 0) ) {
+            _resolve();
+        }
+        if ( diagCompID != NULL && millis() - _msDiag >= diagInterval ) _diagReport();
+        if ( store != NULL ) _replay();
+
+        for (uint8_t i = 0; i < _nConn && ret == NO_STATUS; i++) {
+            gsConn& c = _conn[_nextConn];
+            if (++_nextConn >= _nConn) _nextConn = 0;
+            ret = _run(c);
+        }
+    }
+
+    // the LED is on while any connection has a request in progress
+    bool busy = false;
+    for (uint8_t i = 0; i < _nConn; i++) {
+        if (_conn[i].state != GS_WAIT) busy = true;
+    }
+    if (_ledPin >= 0 && busy != _ledOn) digitalWrite(_ledPin, busy ? HIGH : LOW);
+    _ledOn = busy;
+
+    if (ret != NO_STATUS) lastStatus = ret;
+    runTime = micros() - usStart;
+    if (runTime > runTimeMax) runTimeMax = runTime;
+    return ret;
+}
 
-    switch (GS_STATE)
+// advance one connection's state machine by one step
+ethernetStatus_t GroveStreams::_run(gsConn& c)
+{
+    ethernetStatus_t ret = NO_STATUS;
+
+    switch (c.state)
     {
     case GS_WAIT:   // wait for next send
+        if ( c.open ) {
+            // close an idle keep-alive connection if it times out, or if the server closed it
+            if ( !c.client->connected() ) {
+                GS_INFO( F(" server closed connection ") << c.id << endl );
+                GS_EVENT(EV_SERVER_CLOSE, c.requests);
+                c.state = GS_DISCONNECT;
+                break;
+            }
+            else if ( millis() - c.msIdle >= idleTimeout ) {
+                GS_INFO( F(" idle timeout ") << c.id << endl );
+                GS_EVENT(EV_IDLE_CLOSE, c.requests);
+                c.state = GS_DISCONNECT;
+                break;
+            }
+        }
+        if ( _dnsValid && _mayConnect() && _mayPut() && _batchReady(c) ) {
+            _spendToken(c);
+            c.state = GS_CONNECT;
+        }
         break;
 
-    case GS_SEND:
-        if ( _xmit() == PUT_COMPLETE ) {
-            _msLastPacket = millis();   // initialize receive timeout
-            GS_STATE = GS_RECV;
-            ret = PUT_COMPLETE;
+    // each of the following states does one bounded piece of work per call,
+    // so that run() returns quickly to the caller.
+    case GS_CONNECT:
+        if ( _connect(c) ) {
+            c.state = GS_SEND_HEADERS;
         }
         else {
-            GS_STATE = GS_WAIT;
+            _dequeue(c, true);
+            _dnsInterval = 0;       // look up the address again, in case it changed
+            c.state = GS_WAIT;
             ++connFail;
-            ++nError;
+            _failure();
             ret = CONNECT_FAILED;
         }
         break;
 
+    case GS_SEND_HEADERS:
+        _sendHeaders(c);
+        if (c.bodyLen > 0) {
+            c.state = GS_SEND_BODY;
+        }
+        else {
+            ret = _putComplete(c);
+        }
+        break;
+
+    case GS_SEND_BODY:
+        if ( _sendBody(c) ) ret = _putComplete(c);
+        break;
+
     case GS_RECV:
-        {
-            boolean haveStatus = false;
-
-            if(m_client->connected()) {
-                uint16_t nChar = m_client->available();
-                if (nChar > 0) {
-                    _msLastPacket = millis();
-                    Serial << _msLastPacket << F(" received packet, len=") << nChar << endl;
-                    char* b = statusBuf;
-                    for (uint16_t i = 0; i < nChar; i++) {
-                        char ch = m_client->read();
-                        Serial << _BYTE(ch);
-                        if ( !haveStatus && i < sizeof(statusBuf) ) {
-                            if ( ch == '\r' || i == sizeof(statusBuf) - 1 ) {
-                                haveStatus = true;
-                                *b++ = 0;
-                                if (strncmp(statusBuf, httpOKText, sizeof(httpOKText)) == 0) {
-                                    ++httpOK;
-                                    nError = 0;
-                                    ret = HTTP_OK;
-                                }
-                                else {
-                                    ++httpOther;
-                                    ++nError;
-                                    ret = HTTP_OTHER;
-                                    Serial << endl << endl << millis() << F(" HTTP STATUS: ") << statusBuf << endl;
-                                }
-                            }
-                            else {
-                                *b++ = ch;
-                            }
-                        }
+        if(c.client->connected()) {
+            int avail = c.client->available();
+            if (avail > 0) {
+                // read the response in chunks, into the arena, but no more than
+                // RECV_MAX characters per call. whatever is left is read next time.
+                uint8_t* buf = (uint8_t*)_arena;
+                uint16_t nRead = 0;
+                bool haveStatus = c.http.haveStatus();
+                bool haveHeaders = c.http.haveHeaders();
+                c.msLastPacket = millis();
+                while (avail > 0 && nRead < RECV_MAX && !c.http.complete) {
+                    int n = c.client->read( buf, avail < (int)PKTSIZE ? avail : PKTSIZE );
+                    if (n <= 0) break;
+                    c.http.parse(buf, n);
+                    nRead += n;
+                    avail -= n;
+                }
+                GS_INFO( F(" received ") << nRead << endl );
+                if (!haveStatus && c.http.haveStatus()) ret = _httpStatus(c);
+                if (!haveHeaders && c.http.haveHeaders()) {
+                    // use the headers now, since a body without a length only
+                    // ends when the server closes the connection
+                    _setClock(c.http.date, millis() - c.msPutComplete);
+                    if (c.http.status != 200 && c.http.retryAfter > 0 && backoff < c.http.retryAfter * 1000UL) {
+                        backoff = c.http.retryAfter * 1000UL;   // the server asked us to wait
+                        _msFail = millis();
+                    }
+                }
+                if (c.http.complete) {
+                    respTime = c.msLastPacket - c.msPutComplete;
+                    GS_HIST(respHist, respTime);
+                    _dequeue(c, _retryable(c));
+                    if (keepAlive && !c.http.close) {
+                        // leave the connection open for the next request
+                        GS_INFO( F(" response complete, ") << c.requests << F(" requests on this connection\n") );
+                        c.msIdle = millis();
+                        c.state = GS_WAIT;
+                    }
+                    else {
+                        c.state = GS_DISCONNECT;
                     }
                 }
-                // if too much time has elapsed since the last packet, time out and close the connection from this end
-                else if (millis() - _msLastPacket >= RECEIVE_TIMEOUT) {
-                    _msLastPacket = millis();
-                    Serial << endl << _msLastPacket << F(" Recv timeout\n");
-                    m_client->stop();
-                    if (_ledPin >= 0) digitalWrite(_ledPin, LOW);
-                    GS_STATE = GS_DISCONNECT;
+            }
+            // if too much time has elapsed since the last packet, time out and close the connection from this end
+            else if (millis() - c.msLastPacket >= RECEIVE_TIMEOUT) {
+                c.msLastPacket = millis();
+                GS_ERROR( F(" Recv timeout ") << c.id << endl );
+                GS_EVENT(EV_RECV_TIMEOUT, c.requests);
+                c.client->stop();
+                if (_retryStale(c)) break;
+                c.state = GS_DISCONNECT;
+                ++recvTimeout;
+                _failure();
+                ret = TIMEOUT;
+            }
+        }
+        else {
+            if (_retryStale(c)) break;
+            c.state = GS_DISCONNECT;
+            ret = DISCONNECTING;
+            if ( !c.http.haveStatus() ) {
+                // closed with no response. on a new connection the server
+                // refused the request, so count it as a connection failure.
+                GS_ERROR( F(" closed without response ") << c.id << endl );
+                GS_EVENT(EV_SERVER_CLOSE, c.requests);
+                if (c.requests == 1) {
+                    _dnsInterval = 0;       // look up the address again, in case it changed
+                    ++connFail;
+                    ret = CONNECT_FAILED;
+                }
+                else {
                     ++recvTimeout;
-                    ++nError;
                     ret = TIMEOUT;
                 }
+                _failure();
             }
-            else {
-                GS_STATE = GS_DISCONNECT;
-                ret = DISCONNECTING;
-            }
-            break;
         }
+        break;
 
     case GS_DISCONNECT:
+    {
         // close client end
-        _msDisconnecting = millis();
-        Serial << _msDisconnecting << F(" disconnecting\n");
-        m_client->stop();
-        if (_ledPin >= 0) digitalWrite(_ledPin, LOW);
-        _msDisconnected = millis();
-        respTime = _msLastPacket - _msPutComplete;
-        discTime = _msDisconnected - _msDisconnecting;
-        Serial << _msDisconnected << F(" disconnected\n\n");
-        GS_STATE = GS_WAIT;
+        uint32_t msDisconnecting = millis();
+        GS_INFO( F(" disconnecting ") << c.id << endl );
+        c.client->stop();
+        if (c.nSend > 0) {      // response not parsed to completion
+            respTime = c.msLastPacket - c.msPutComplete;
+            GS_HIST(respHist, respTime);
+        }
+        discTime = millis() - msDisconnecting;
+        GS_HIST(discHist, discTime);
+        GS_INFO( F(" disconnected\n\n") );
+        GS_EVENT(EV_DISCONNECTED, discTime);
+        _dequeue(c, c.nSend > 0 && _retryable(c));
+        c.open = false;
+        c.state = GS_WAIT;
         ret = DISCONNECTED;
         break;
     }
-    if (ret != NO_STATUS) lastStatus = ret;
+    }
     return ret;
 }
 
-// send data to GroveStreams. returns SEND_BUSY if e.g. transmission already in progress,
-// waiting response, etc., else returns SEND_ACCEPTED.
-ethernetStatus_t GroveStreams::send(const char* compID, const char* data)
+// count an error that suggests the server or network is down, and back off
+// before the next attempt: backoffMin doubled for each consecutive error, up
+// to backoffMax, with random jitter so that many gateways do not retry in
+// step. opens the circuit breaker after breakerThreshold consecutive errors,
+// or if the trial request while half open fails.
+void GroveStreams::_failure()
+{
+    if (nError < 255) ++nError;
+    uint32_t d = backoffMin;
+    for (uint8_t i = 1; i < nError && d < backoffMax; i++) d *= 2;
+    if (d > backoffMax) d = backoffMax;
+    d = d / 2 + random(d / 2 + 1);
+    backoff = d;
+    _msFail = millis();
+    GS_INFO( F(" backoff ") << backoff << endl );
+
+    if (breaker == GS_BREAKER_HALF_OPEN) {
+        _setBreaker(GS_BREAKER_OPEN);
+    }
+    else if (breaker == GS_BREAKER_CLOSED && nError >= breakerThreshold) {
+        _msOpened = millis();
+        ++breakerTrips;
+        _setBreaker(GS_BREAKER_OPEN);
+    }
+}
+
+// a response shows that the server is up
+void GroveStreams::_success()
+{
+    nError = 0;
+    backoff = 0;
+    if (breaker != GS_BREAKER_CLOSED) _setBreaker(GS_BREAKER_CLOSED);
+}
+
+// change the circuit breaker state, to be reported by the next call to run()
+void GroveStreams::_setBreaker(gsBreaker_t state)
+{
+    static const ethernetStatus_t status[] = { BREAKER_CLOSED, BREAKER_OPEN, BREAKER_HALF_OPEN };
+    breaker = state;
+    _breakerStatus = status[state];
+    GS_ERROR( F(" circuit breaker ") << state << endl );
+    GS_EVENT(EV_BREAKER, state);
+}
+
+// true if a request may be started now, i.e. not waiting out a backoff
+// delay, and, while the circuit breaker is half open, no other request
+// is in progress. when the delay after the breaker opened has passed, it
+// becomes half open.
+bool GroveStreams::_mayConnect()
+{
+    if (backoff > 0 && millis() - _msFail < backoff) return false;
+    if (breaker == GS_BREAKER_OPEN) _setBreaker(GS_BREAKER_HALF_OPEN);
+    if (breaker == GS_BREAKER_HALF_OPEN) {
+        for (uint8_t i = 0; i < _nConn; i++) {
+            if (_conn[i].state != GS_WAIT) return false;
+        }
+    }
+    return true;
+}
+
+// the number of PUTs that may be sent now without exceeding the rate limit.
+// the limit is a sliding window, as the server's is: no more than putBurst
+// PUTs in any putBurst x putInterval ms. (a token bucket of putBurst tokens
+// that refills at one per putInterval would allow up to twice that.) an
+// application can use this to adapt its sampling rate.
+uint8_t GroveStreams::tokens()
+{
+    uint8_t burst = putBurst < PUT_BURST ? putBurst : PUT_BURST;
+    if (putInterval == 0) return burst;
+    uint32_t window = burst * putInterval;
+    uint8_t n = burst;
+    for (uint8_t i = 0; i < burst; i++) {
+        if (millis() - _msPut[i] < window) {
+            --n;
+        }
+        else {
+            _msPut[i] = millis() - window;      // so that old times do not wrap around to look recent
+        }
+    }
+    return n;
+}
+
+// count a PUT against the rate limit, in place of the oldest one in the window.
+// its time is set again when the request ends, when the server has surely
+// seen it, so that the window here never ends before the server's does.
+void GroveStreams::_spendToken(gsConn& c)
+{
+    uint8_t burst = putBurst < PUT_BURST ? putBurst : PUT_BURST;
+    uint8_t oldest = 0;
+    for (uint8_t i = 1; i < burst; i++) {
+        if (millis() - _msPut[i] > millis() - _msPut[oldest]) oldest = i;
+    }
+    _msPut[oldest] = millis();
+    c.putSlot = oldest;
+}
+
+// true if a PUT may be started now without exceeding the rate limit. if
+// not, sends stay in the queue, to be combined into one batch PUT when the
+// next token arrives.
+bool GroveStreams::_mayPut()
+{
+    if ( tokens() > 0 ) {
+        _putHeld = false;
+        return true;
+    }
+    if (!_putHeld) {
+        for (uint8_t i = 0; i < _queue.count(); i++) {
+            if (_queue.owner(i) == gsQueue::WAITING) {
+                _putHeld = true;
+                ++putDeferred;
+                GS_INFO( F(" PUT budget used up\n") );
+                break;
+            }
+        }
+    }
+    return false;
+}
+
+// true if no connection has a request in progress or is open
+bool GroveStreams::_idle()
+{
+    for (uint8_t i = 0; i < _nConn; i++) {
+        if (_conn[i].state != GS_WAIT || _conn[i].open) return false;
+    }
+    return true;
+}
+
+// if a request sent on a reused keep-alive connection got no response, the
+// server probably closed the connection while it was idle, or it is half-open.
+// close it and send the request again on a new connection.
+bool GroveStreams::_retryStale(gsConn& c)
+{
+    if (c.http.haveStatus() || c.requests < 2) return false;
+
+    GS_ERROR( F(" stale connection, reconnecting\n") );
+    GS_EVENT(EV_STALE, c.requests);
+    c.client->stop();
+    c.open = false;
+    ++reconnects;
+    c.state = GS_CONNECT;
+    return true;
+}
+
+#if GS_STATS
+// copy the statistics to s, which the caller provides, since gsStats is too
+// big to return on the stack of a small board
+void GroveStreams::snapshot(gsStats& s)
+{
+    s.ms = millis();
+    s.sendSeq = sendSeq;
+    s.sendBusy = sendBusy;
+    s.sendShed = sendShed;
+    s.breakerTrips = breakerTrips;
+    s.putDeferred = putDeferred;
+    s.sendOK = sendOK;
+    s.sendLost = sendLost;
+    s.httpOK = httpOK;
+    s.httpOther = httpOther;
+    s.connFail = connFail;
+    s.recvTimeout = recvTimeout;
+    s.dnsFail = dnsFail;
+    s.connReused = connReused;
+    s.reconnects = reconnects;
+    s.bytesSent = bytesSent;
+    s.runTimeMax = runTimeMax;
+    s.queueMax = queueMax;
+    s.backlog = backlog;
+    s.stored = stored;
+    s.replayed = replayed;
+    memcpy(s.prioOK, prioOK, sizeof(prioOK));
+    memcpy(s.prioDropped, prioDropped, sizeof(prioDropped));
+#if GS_HISTOGRAMS
+    s.connHist = connHist;
+    s.respHist = respHist;
+    s.discHist = discHist;
+    s.queueHist = queueHist;
+    for (uint8_t p = 0; p < GS_PRIORITIES; p++) s.prioHist[p] = prioHist[p];
+#endif
+}
+#endif
+
+// zero the statistics. nError is not affected.
+void GroveStreams::resetStats()
+{
+    sendSeq = 0;
+    sendBusy = 0;
+    sendShed = 0;
+    breakerTrips = 0;
+    putDeferred = 0;
+    sendOK = 0;
+    sendLost = 0;
+    httpOK = 0;
+    httpOther = 0;
+    connFail = 0;
+    recvTimeout = 0;
+    dnsFail = 0;
+    connReused = 0;
+    reconnects = 0;
+    bytesSent = 0;
+    runTimeMax = 0;
+    queueMax = queued;
+    stored = 0;
+    replayed = 0;
+    memset(prioOK, 0, sizeof(prioOK));
+    memset(prioDropped, 0, sizeof(prioDropped));
+#if GS_HISTOGRAMS
+    connHist.reset();
+    respHist.reset();
+    discHist.reset();
+    queueHist.reset();
+    for (uint8_t p = 0; p < GS_PRIORITIES; p++) prioHist[p].reset();
+#endif
+}
+
+// queue a report of the statistics since the last report to the diagnostics
+// component, then reset them.
+void GroveStreams::_diagReport()
+{
+    char buf[135];      // the longest report, with every number at its maximum
+
+    _msDiag = millis();
+    int n = snprintf_P(buf, sizeof(buf), PSTR("&ok=%lu&oth=%lu&cf=%lu&to=%lu&busy=%lu&rt=%lu&qm=%u"),
+        (unsigned long)httpOK, (unsigned long)httpOther, (unsigned long)connFail, (unsigned long)recvTimeout,
+        (unsigned long)sendBusy, (unsigned long)runTimeMax, queueMax);
+#if GS_HISTOGRAMS
+    snprintf_P(buf + n, sizeof(buf) - n, PSTR("&c95=%u&r50=%u&r95=%u&r99=%u"),
+        connHist.percentile(95), respHist.percentile(50), respHist.percentile(95), respHist.percentile(99));
+#else
+    (void)n;
+#endif
+    resetStats();
+    send(diagCompID, buf);
+}
+
+// count the status of the response just received. returns HTTP_OK or HTTP_OTHER.
+ethernetStatus_t GroveStreams::_httpStatus(gsConn& c)
+{
+    _lastConn = c.id - 1;
+    httpStatus = c.http.status;
+    GS_EVENT(EV_HTTP_STATUS, httpStatus);
+    if (httpStatus == 200) {
+        ++httpOK;
+        sendOK += c.nSend;
+        _countSends(c, true);
+        _success();
+        return HTTP_OK;
+    }
+    else {
+        ++httpOther;
+        GS_ERROR( F(" HTTP STATUS: ") << httpStatus << endl );
+        if (httpStatus == 429) {
+            // the server says the budget is used up. start over, with one
+            // PUT allowed each putInterval from now on.
+            for (uint8_t i = 0; i < PUT_BURST; i++) _msPut[i] = millis() - i * putInterval;
+        }
+        if ( _retryable(c) ) {
+            _failure();     // server error, or too busy
+        }
+        else {
+            _success();     // the server is up, but it did not accept this request
+        }
+        return HTTP_OTHER;
+    }
+}
+
+// queue data to be sent to GroveStreams. the component ID and data are copied,
+// so the caller's buffers can be reused immediately. returns SEND_BUSY if the
+// queue is full, else returns SEND_ACCEPTED.
+ethernetStatus_t GroveStreams::send(const char* compID, const char* data, gsPriority_t priority)
+{
+    sendBegin(compID, priority);
+    addData(data);
+    return sendEnd();
+}
+
+// start building a send in place in the queue. add the datastreams with
+// addInt(), addFixed(), addFloat(), addString() or addData(), then queue it
+// with sendEnd(). values are formatted straight into the queue, so no other
+// buffer is needed. do not call send() or run() before sendEnd(), since they
+// may start a send of their own. returns false if the queue is full, in
+// which case the adds do nothing and sendEnd() returns SEND_BUSY. bulk sends
+// cannot use the last urgentReserve queue entries, nor the last quarter of
+// the queue's storage, which are kept for urgent sends.
+bool GroveStreams::sendBegin(const char* compID, gsPriority_t priority)
+{
+    bool bulk = (priority == GS_BULK);
+    _priority = priority;
+
+    // with a store, make room by moving the oldest waiting sends to it,
+    // rather than rejecting the new one. the adds make more room as the
+    // send grows, see _makeRoom().
+    if (store != NULL) {
+        while ( _queue.count() >= QUEUE_DEPTH || _queue.room() < _keep() + strlen(compID) + 2 || (bulk && _bulkFull()) ) {
+            if ( !_spillOldest() ) break;
+        }
+    }
+    if (bulk && _bulkFull()) {
+        _queue.abandon();
+        return false;
+    }
+    return _queue.open(compID, _keep());
+}
+
+// queue space that the send being built must leave free: a quarter of the
+// arena for a bulk send, if there is an urgent reserve
+uint16_t GroveStreams::_keep()
+{
+    return _priority == GS_BULK && urgentReserve > 0 ? QUEUE_ARENA / 4 : 0;
+}
+
+// move the oldest waiting send to the store, bulk ones first. urgent sends
+// are only moved to make room for another urgent send. returns false if
+// there is none to move.
+bool GroveStreams::_spillOldest()
+{
+    uint8_t n = _queue.count();
+    uint8_t i = 0;
+    uint8_t urgent = n;
+    for ( ; i < n; i++) {
+        if (_queue.owner(i) != gsQueue::WAITING) continue;
+        if ( !(_queue.flags(i) & gsQueue::URGENT) ) break;
+        if (urgent == n) urgent = i;
+    }
+    if (i >= n && _priority != GS_BULK) i = urgent;
+    if (i >= n) return false;
+    _spill(i);
+    _queue.release(gsQueue::DONE);
+    queued = _queue.count();
+    _updatePending();
+    return true;
+}
+
+// with a store, make sure that len more characters fit in the send being
+// built, by moving waiting sends to the store and moving the send into the
+// space they leave, so that it is not rejected for lack of room.
+void GroveStreams::_makeRoom(uint16_t len)
+{
+    if (store == NULL) return;
+    while ( _queue.isOpen() && _queue.openFree() < len ) {
+        if ( !_spillOldest() ) break;
+        _queue.grow(_keep());
+    }
+}
+
+// the most data a send for compID can hold, i.e. with the queue empty: the
+// arena, less the urgent share for a bulk send, the component ID, the
+// terminators, and the time stamp if one is added. longer sends are never
+// accepted.
+uint16_t GroveStreams::maxData(const char* compID, gsPriority_t priority)
+{
+    uint16_t room = QUEUE_ARENA;
+    if (priority == GS_BULK && urgentReserve > 0) room -= QUEUE_ARENA / 4;
+    uint16_t need = strlen(compID) + 2;
+    if (timeStamp && !bypassMode) need += 19;       // "&time=" and 13 digits
+    return room > need ? room - need : 0;
+}
+
+// add a datastream with a fixed-point value, i.e. value / 10^decimals,
+// e.g. addFixed("C", 215, 1) adds "&C=21.5"
+void GroveStreams::addFixed(const char* id, int32_t value, uint8_t decimals)
+{
+    _makeRoom( _encodedLen(id) + 14 + decimals );      // "&id=", sign, 10 digits, point and leading zeros
+    _addKey(id);
+    _queue.appendNumber(value, decimals);
+}
+
+// add a datastream with a floating point value, rounded to the given number
+// of decimal places. NaN, and values too large to format as a 32-bit fixed
+// point number, are left out.
+void GroveStreams::addFloat(const char* id, float value, uint8_t decimals)
+{
+    for (uint8_t i = 0; i < decimals; i++) value *= 10;
+    value += value < 0 ? -0.5 : 0.5;
+    if ( !(value > -2147483647.0 && value < 2147483647.0) ) return;
+    addFixed(id, (int32_t)value, decimals);
+}
+
+// add a datastream with a text value, which is URL-encoded
+void GroveStreams::addString(const char* id, const char* value)
+{
+    _makeRoom( _encodedLen(id) + _encodedLen(value) + 2 );
+    _addKey(id);
+    _urlEncode(value);
+}
+
+// finish the send started by sendBegin() and queue it. returns SEND_BUSY if
+// the queue is full or the send did not fit, SEND_SHED if the circuit
+// breaker is open and there is no store, else returns SEND_ACCEPTED.
+ethernetStatus_t GroveStreams::sendEnd()
 {
     ++sendSeq;
-    if (bypassMode) {
-        Serial << millis() << F(" BYPASS ") << sendSeq << ' ' << compID << ' ' << data << endl;
+    if ( timeStamp && !bypassMode && _queue.isOpen() ) {
+        // stamp the send with the time now, unless the caller gave one
+        const char* compID = _queue.openEntry();
+        char time[24];
+        if ( strstr_P(compID + strlen(compID) + 1, PSTR("time=")) == NULL && _timeText(time, millis()) ) {
+            _makeRoom( strlen(time) );
+            _queue.append(time);
+        }
+    }
+    if (breaker == GS_BREAKER_OPEN && store == NULL && !bypassMode) {
+        // the server is down, so reject the send now rather than hold it
+        _queue.abandon();
+        ++sendShed;
+        ++prioDropped[_priority];
+        lastStatus = SEND_SHED;
+    }
+    else if (bypassMode) {
+        if (_queue.isOpen()) {
+            const char* compID = _queue.openEntry();
+            Serial << millis() << F(" BYPASS ") << sendSeq << ' ' << compID << ' ' << compID + strlen(compID) + 1 << endl;
+        }
+        _queue.abandon();
         lastStatus = SEND_ACCEPTED;
     }
-    else if (GS_STATE == GS_WAIT) {
-        _compID = compID;
-        _data = data;
-        GS_STATE = GS_SEND;
+    else if ( _queue.close(_priority == GS_URGENT ? gsQueue::URGENT : 0) ) {
+        queued = _queue.count();
+        if (queued > queueMax) queueMax = queued;
+        const char* compID;
+        const char* data;
+        if ( batchWindow > 0 && _queue.peek(compID, data, queued - 1) ) {
+            batchWriter w(NULL);
+            w.first = (_batchPending == 0);
+            _putItems(w, compID, data);
+            _batchPending += w.n;
+        }
         lastStatus = SEND_ACCEPTED;
     }
     else {
+        _queueFull = true;
         ++sendBusy;
+        ++prioDropped[_priority];
+        GS_EVENT(EV_SEND_BUSY, queued);
         lastStatus = SEND_BUSY;
     }
     return lastStatus;
 }
 
-// transmit data to GroveStreams
-ethernetStatus_t GroveStreams::_xmit()
-{
-    ethernetPacket packet(m_client);
-
-    _msConnect = millis();
-    Serial << _msConnect << F(" connecting\n");
-    if (_ledPin >= 0) digitalWrite(_ledPin, HIGH);
-    if ( m_client->connect(serverIP, serverPort) ) {
-        _msConnected = millis();
-        Serial << _msConnected << F(" connected\n");
-        packet.putChar( F("PUT /api/feed?&api_key=") );
-        packet.putChar(_apiKey);
-        packet.putChar( F("&compId=") );
-        packet.putChar(_compID);
-        packet.putChar(_data);
-        packet.putChar( F(" HTTP/1.1\r\nHost: ") );
-        packet.putChar(_groveStreamsIP);
-        packet.putChar( F("\r\nConnection: close\r\nX-Forwarded-For: ") );
-        packet.putChar(_compID);
-        packet.putChar( F("\r\nContent-Type: application/json\r\n\r\n") );
-        packet.flush();
-        _msPutComplete = millis();
-        Serial << _msPutComplete << F(" PUT complete ") << strlen(_data) << endl;
-        connTime = _msConnected - _msConnect;
-        lastStatus = PUT_COMPLETE;
+// add data already formatted as "&id=val" to the send being built
+void GroveStreams::addData(const char* data)
+{
+    _makeRoom( strlen(data) );
+    _queue.append(data);
+}
+
+// add "&id=" to the send being built
+void GroveStreams::_addKey(const char* id)
+{
+    _queue.append('&');
+    _urlEncode(id);
+    _queue.append('=');
+}
+
+// true if a character is sent as is, rather than percent-encoded
+static bool unreserved(char c)
+{
+    return isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~';
+}
+
+// length of text once it is percent-encoded
+uint16_t GroveStreams::_encodedLen(const char* s)
+{
+    uint16_t len = 0;
+    for ( ; *s; s++) len += unreserved(*s) ? 1 : 3;
+    return len;
+}
+
+// add text to the send being built, percent-encoding all but the unreserved
+// characters
+void GroveStreams::_urlEncode(const char* s)
+{
+    for ( ; *s; s++) {
+        char c = *s;
+        if ( unreserved(c) ) {
+            _queue.append(c);
+        }
+        else {
+            uint8_t h = (uint8_t)c >> 4, l = c & 0x0F;
+            _queue.append('%');
+            _queue.append( h < 10 ? '0' + h : 'A' + h - 10 );
+            _queue.append( l < 10 ? '0' + l : 'A' + l - 10 );
+        }
+    }
+}
+
+// remove the send(s) just completed on a connection from the queue. if they
+// failed, and there is a store, they are written to it to be sent later.
+void GroveStreams::_dequeue(gsConn& c, bool failed)
+{
+    if (failed && store != NULL) {
+        for (uint8_t i = 0; i < _queue.count(); i++) {
+            if (_queue.owner(i) == c.id) _spill(i);
+        }
+    }
+    else if ( !c.http.haveStatus() || c.http.status != 200 ) {
+        sendLost += c.nSend;
+        _countSends(c, false);
+    }
+    if (c.nSend > 0) _msPut[c.putSlot] = millis();
+    _queue.release(c.id);
+    c.nSend = 0;
+    queued = _queue.count();
+    _queueFull = false;
+    _updatePending();
+}
+
+// true if the request in progress on a connection failed in a way that
+// sending it again later may fix, i.e. there was no response, the server
+// had an error, or it was too busy.
+bool GroveStreams::_retryable(gsConn& c)
+{
+    return !c.http.haveStatus() || c.http.status >= 500 || c.http.status == 429;
+}
+
+// write queued send n to the store, marked with the time it was queued if
+// the server time is known, and mark it done so it is removed from the queue.
+// the time is left off if the record would then be too long to replay. if
+// the store is full, the send is lost, and counted in sendLost.
+void GroveStreams::_spill(uint8_t n)
+{
+    const char* compID;
+    const char* data;
+    char time[24] = "";
+
+    if ( !_queue.peek(compID, data, n) ) return;
+    if ( !(_queue.flags(n) & gsQueue::REPLAY) && strstr_P(data, PSTR("time=")) == NULL ) {
+        _timeText(time, _queue.timeQueued(n));
+        if ( strlen(compID) + strlen(data) + strlen(time) + 2 > QUEUE_ARENA ) time[0] = '\0';
+    }
+    if ( store->append(compID, data, time) ) {
+        ++stored;
     }
     else {
-        _msConnected = millis();
-        connTime = _msConnected - _msConnect;
-        Serial << _msConnected << F(" connect failed\n");
-        if (_ledPin >= 0) digitalWrite(_ledPin, LOW);
-        lastStatus = CONNECT_FAILED;
+        GS_ERROR( F(" store full, send lost\n") );
+        ++sendLost;
+        ++prioDropped[(_queue.flags(n) & gsQueue::URGENT) ? GS_URGENT : GS_BULK];
     }
-    return lastStatus;
+    _queue.setOwner(n, gsQueue::DONE);
+}
+
+// write everything in the queue to the store, e.g. before a reset
+void GroveStreams::_spillAll()
+{
+    for (uint8_t i = 0; i < _queue.count(); i++) {
+        if (_queue.owner(i) != gsQueue::DONE) _spill(i);
+    }
+    _queue.release(gsQueue::DONE);
+}
+
+// move stored sends back into the queue, at most once every replayInterval
+// ms, and only while the circuit breaker is not open and the last sends
+// replayed have left the queue. while it is half open, the replayed sends
+// are the trial request, so the backlog drains without new sends. up to half the queue is used, leaving room for new sends,
+// and replayed sends are bulk sends, so they do not use the urgent reserve.
+// replayed sends are always sent in a batch, with their original times.
+void GroveStreams::_replay()
+{
+    backlog = store->count();
+    if ( backlog == 0 || breaker == GS_BREAKER_OPEN || !_dnsValid || millis() - _msReplay < replayInterval ) return;
+    for (uint8_t i = 0; i < _queue.count(); i++) {
+        if (_queue.owner(i) != gsQueue::DONE && (_queue.flags(i) & gsQueue::REPLAY)) return;
+    }
+
+    _msReplay = millis();
+    uint16_t keep = urgentReserve > 0 ? QUEUE_ARENA / 4 : 0;
+    for (uint8_t n = 0; n < (QUEUE_DEPTH + 1) / 2 && !_bulkFull(); ) {
+        uint16_t room;
+        char* p = _queue.reserve(room, keep);
+        uint16_t len = store->peek(p, room);
+        if (len == 0) break;
+        if (len > QUEUE_ARENA) {
+            GS_ERROR( F(" stored send too long, dropped\n") );
+            store->pop();
+            continue;
+        }
+        if (len > room && len > QUEUE_ARENA - keep) {
+            // too long to ever fit beside the urgent share, so it may use
+            // that too, rather than hold up the rest of the store for good
+            p = _queue.reserve(room, 0);
+            if (len <= room) store->peek(p, room);
+        }
+        if (len > room) break;
+        _queue.commit(len, gsQueue::REPLAY);
+        store->pop();
+        ++replayed;
+        ++n;
+    }
+    _queue.abandon();
+    queued = _queue.count();
+    if (queued > queueMax) queueMax = queued;
+    _updatePending();
+    backlog = store->count();
+    GS_INFO( F(" replay, backlog ") << backlog << endl );
+}
+
+// the server time, seconds since 1970 UTC, from the Date headers of its
+// responses. returns zero until the first one is received.
+uint32_t GroveStreams::now()
+{
+    uint32_t sec;
+    uint16_t msec;
+    return _epochAt(millis(), sec, msec) ? sec : 0;
+}
+
+// set the clock from the time t of an HTTP Date header, seconds since 1970.
+// the header has a resolution of a second, and the server wrote it some time
+// in the latency ms since the request was sent, so the time now is between
+// the header time and a second plus the latency later. if the clock is
+// already within that window it is left alone, otherwise it is moved just
+// enough to be in it. the adjustments add up to the error in millis(), which
+// is used to update clockDrift every DRIFT_INTERVAL or so.
+void GroveStreams::_setClock(uint32_t t, uint32_t latency)
+{
+    if (t == 0) return;
+
+    unsigned long ms = millis();
+    uint32_t sec;
+    uint16_t msec;
+    int32_t adjust = CLOCK_STEP;
+    if ( _epochAt(ms, sec, msec) && sec - t + 60 <= 120 ) {
+        int32_t early = (int32_t)(sec - t) * 1000 + msec;     // ms the clock is ahead of the header time
+        int32_t window = 1000 + (latency < 10000 ? latency : 10000);
+        adjust = early < 0 ? -early : early > window ? window - early : 0;
+    }
+
+    if (adjust >= CLOCK_STEP || adjust <= -CLOCK_STEP) {
+        // first time, or too far off to be drift, so set the clock outright
+        GS_INFO( F(" clock set ") << t << endl );
+        _epoch = t;
+        _epochMs = 500;
+        _msDrift = ms;
+        _driftAdjust = 0;
+    }
+    else {
+        int32_t total = (int32_t)msec + adjust;
+        int32_t s = total / 1000;
+        total %= 1000;
+        if (total < 0) {
+            total += 1000;
+            --s;
+        }
+        _epoch = sec + s;
+        _epochMs = total;
+        _driftAdjust += adjust;
+        if (ms - _msDrift >= DRIFT_INTERVAL) {
+            clockDrift += (int32_t)( _driftAdjust * 1e6 / (ms - _msDrift) );
+            if (clockDrift > MAX_DRIFT) clockDrift = MAX_DRIFT;
+            if (clockDrift < -MAX_DRIFT) clockDrift = -MAX_DRIFT;
+            GS_INFO( F(" clock drift ") << clockDrift << F(" ppm\n") );
+            _msDrift = ms;
+            _driftAdjust = 0;
+        }
+    }
+    _msEpoch = ms;
+    clockAdjust = adjust;
+}
+
+// the server time at the given millis() value, corrected for clock drift,
+// as seconds since 1970 and milliseconds. returns false if it is not known.
+bool GroveStreams::_epochAt(unsigned long ms, uint32_t& sec, uint16_t& msec)
+{
+    if (_epoch == 0) return false;
+    int32_t elapsed = ms - _msEpoch;        // negative for times before the clock was set
+    elapsed += (int32_t)( elapsed * (clockDrift / 1e6) );
+    int32_t total = (int32_t)_epochMs + elapsed;
+    int32_t s = total / 1000;
+    total %= 1000;
+    if (total < 0) {
+        total += 1000;
+        --s;
+    }
+    sec = _epoch + s;
+    msec = total;
+    return true;
+}
+
+// write "&time=" and the server time at the given millis() value, in ms since
+// 1970, without 64-bit arithmetic. returns false, leaving buf alone, if the
+// server time is not known.
+bool GroveStreams::_timeText(char* buf, unsigned long ms)
+{
+    uint32_t sec;
+    uint16_t msec;
+    if ( !_epochAt(ms, sec, msec) ) return false;
+    sprintf_P(buf, PSTR("&time=%lu%03u"), (unsigned long)sec, (unsigned)msec);
+    return true;
+}
+
+// recalculate the body size for the sends not yet being sent
+void GroveStreams::_updatePending()
+{
+    batchWriter w(NULL);
+    if (batchWindow > 0) {
+        for (uint8_t i = 0; i < _queue.count(); i++) {
+            const char* compID;
+            const char* data;
+            if ( _queue.owner(i) != gsQueue::WAITING || !_queue.peek(compID, data, i) ) continue;
+            _putItems(w, compID, data);
+        }
+    }
+    _batchPending = w.n;
+}
+
+// determine whether queued data should be sent now on the given connection,
+// and which sends go into its next PUT. the sends are marked with the
+// connection's ID so that no other connection takes them. urgent sends are
+// served first, and sent at once, but after urgentMax PUTs in a row have
+// served them first while bulk sends waited, the next PUT serves bulk sends
+// first. when batching, bulk sends are held until the oldest has waited
+// batchWindow ms, the queue is full, or the body would reach batchBytes, and
+// a PUT takes sends of the priority it serves first, then the other. when the
+// PUT budget is down to its last token, all waiting sends go as one batch,
+// whether batching or not.
+bool GroveStreams::_batchReady(gsConn& c)
+{
+    uint8_t n = _queue.count();
+    uint8_t first = n;          // oldest waiting send of the priority served first
+    uint8_t firstBulk = n;
+    uint8_t nWaiting = 0;
+    uint8_t nUrgent = 0;
+    for (uint8_t i = 0; i < n; i++) {
+        if (_queue.owner(i) != gsQueue::WAITING) continue;
+        ++nWaiting;
+        if (_queue.flags(i) & gsQueue::URGENT) {
+            if (nUrgent++ == 0) first = i;
+        }
+        else if (firstBulk == n) {
+            firstBulk = i;
+        }
+    }
+    if (nWaiting == 0) return false;
+
+    bool urgent = nUrgent > 0 && (nUrgent == nWaiting || urgentMax == 0 || _urgentRun < urgentMax);
+    if (!urgent) first = firstBulk;
+    bool replay = _queue.flags(first) & gsQueue::REPLAY;
+    bool scarce = putInterval > 0 && tokens() <= 1 && nWaiting > 1;
+    c.batch = replay || scarce || batchWindow > 0;
+    if ( c.batch && nUrgent == 0 && !replay && !scarce && !_queueFull && n < QUEUE_DEPTH
+        && _batchPending + 2 < batchBytes && millis() - _queue.timeQueued(first) < batchWindow ) return false;
+    _urgentRun = (urgent && nUrgent < nWaiting) ? _urgentRun + 1 : 0;
+
+    if (!c.batch) {
+        _queue.peek(c.compID, c.data, first);
+        _queue.setOwner(first, c.id);
+        GS_HIST(queueHist, millis() - _queue.timeQueued(first));
+        c.nSend = 1;
+        return true;
+    }
+
+    // take as many sends as fit in the byte budget, but always at least one
+    batchWriter w(NULL);
+    bool full = false;
+    c.nSend = 0;
+    for (uint8_t pass = 0; pass < 2 && !full; pass++) {
+        for (uint8_t i = 0; i < n; i++) {
+            const char* compID;
+            const char* data;
+            bool served = ( (_queue.flags(i) & gsQueue::URGENT) != 0 ) == urgent;
+            if ( _queue.owner(i) != gsQueue::WAITING || served != (pass == 0)
+                || (batchWindow == 0 && !scarce && !(_queue.flags(i) & gsQueue::REPLAY))
+                || !_queue.peek(compID, data, i) ) continue;
+            _putItems(w, compID, data);
+            if (c.nSend > 0 && w.n + 2 > batchBytes) {     // +2 for the brackets
+                full = true;
+                break;
+            }
+            _queue.setOwner(i, c.id);
+            GS_HIST(queueHist, millis() - _queue.timeQueued(i));
+            ++c.nSend;
+        }
+    }
+    _updatePending();
+    return true;
+}
+
+// true if bulk sends fill all but urgentReserve of the queue entries
+bool GroveStreams::_bulkFull()
+{
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < _queue.count(); i++) {
+        if ( !(_queue.flags(i) & gsQueue::URGENT) ) ++n;
+    }
+    return n + urgentReserve >= QUEUE_DEPTH;
+}
+
+// count the sends in the PUT just completed on a connection by priority, as
+// delivered, with the time since each was queued, or as lost
+void GroveStreams::_countSends(gsConn& c, bool ok)
+{
+    for (uint8_t i = 0; i < _queue.count(); i++) {
+        if (_queue.owner(i) != c.id) continue;
+        uint8_t p = (_queue.flags(i) & gsQueue::URGENT) ? GS_URGENT : GS_BULK;
+        if (ok) {
+            ++prioOK[p];
+            GS_HIST(prioHist[p], millis() - _queue.timeQueued(i));
+        }
+        else {
+            ++prioDropped[p];
+        }
+    }
+}
+
+// write the JSON body for a batch PUT, i.e. the queued sends owned by the
+// connection. only characters in the range [from, to) are written, so the
+// body can be sent in slices. returns the total number of characters. if
+// packet is NULL, just count them.
+uint16_t GroveStreams::_putBatch(gsConn& c, ethernetPacket* packet, uint16_t from, uint16_t to)
+{
+    batchWriter w(packet, from, to);
+    w.put('[');
+    for (uint8_t i = 0; i < _queue.count(); i++) {
+        const char* compID;
+        const char* data;
+        if ( _queue.owner(i) != c.id || !_queue.peek(compID, data, i) ) continue;
+        _putItems(w, compID, data);
+    }
+    w.put(']');
+    return w.n;
+}
+
+// write one queued send as GroveStreams batch feed items, one JSON object
+// per datastream, e.g. "&s=1&C=22.5" becomes
+// {"compId":"c","streamId":"s","data":1},{"compId":"c","streamId":"C","data":22.5}
+// a "time" field is not a datastream, but the sample time (ms since 1970)
+// for all of the send's datastreams.
+void GroveStreams::_putItems(batchWriter& w, const char* compID, const char* data)
+{
+    const char* time = NULL;
+    const char* timeEnd = NULL;
+    const char* p = data;
+
+    while ( (p = strstr_P(p, PSTR("time="))) != NULL ) {
+        if (p == data || p[-1] == '&' || p[-1] == '?') {
+            time = p + 5;
+            timeEnd = time + strcspn(time, "&");
+            break;
+        }
+        p += 5;
+    }
+
+    p = data;
+    while (*p) {
+        if (*p == '&' || *p == '?') {
+            ++p;
+            continue;
+        }
+        const char* id = p;
+        while (*p && *p != '=' && *p != '&') ++p;
+        const char* idEnd = p;
+        if (*p != '=') continue;        // no value, skip it
+        const char* val = ++p;
+        while (*p && *p != '&') ++p;
+        if (val == time) continue;
+
+        if (!w.first) w.put(',');
+        w.first = false;
+        w.put( F("{\"compId\":") );
+        w.putString(compID, compID + strlen(compID));
+        w.put( F(",\"streamId\":") );
+        w.putString(id, idEnd);
+        w.put( F(",\"data\":") );
+        w.putValue(val, p);
+        if (time != NULL) {
+            w.put( F(",\"time\":") );
+            w.putValue(time, timeEnd);
+        }
+        w.put('}');
+    }
+}
+
+// connect to the server, or reuse an open keep-alive connection.
+// returns false if the connection fails.
+bool GroveStreams::_connect(gsConn& c)
+{
+    c.http.begin();
+
+    bool reuse = keepAlive && c.open && c.client->connected();
+    if (c.open && !reuse) c.client->stop();
+
+    c.msConnect = millis();
+    if (reuse) {
+        GS_INFO( F(" reusing connection ") << c.id << endl );
+        ++connReused;
+    }
+    else {
+        GS_INFO( F(" connecting ") << c.id << endl );
+        GS_EVENT(EV_CONNECT, c.id);
+        c.requests = 0;
+    }
+    if ( reuse || c.client->connect(serverIP, serverPort) ) {
+        connTime = millis() - c.msConnect;
+        if (!reuse) {
+            GS_INFO( F(" connected\n") );
+            GS_EVENT(EV_CONNECTED, connTime);
+            GS_HIST(connHist, connTime);
+        }
+        c.open = true;
+        connRequests = ++c.requests;
+        return true;
+    }
+    else {
+        connTime = millis() - c.msConnect;
+        GS_ERROR( F(" connect failed ") << c.id << endl );
+        GS_EVENT(EV_CONNECT_FAIL, connTime);
+        c.open = false;
+        return false;
+    }
+}
+
+// constant parts of the request, stored in flash. their lengths are known
+// at compile time (see ethernetPacket::putFlash).
+const char reqPut[] PROGMEM = "PUT /api/feed?&api_key=";
+const char reqCompID[] PROGMEM = "&compId=";
+const char reqHTTP[] PROGMEM = " HTTP/1.1\r\n";
+const char reqForwarded[] PROGMEM = "X-Forwarded-For: ";
+const char reqNoBody[] PROGMEM = "\r\nContent-Type: application/json\r\nContent-Length: 0\r\n\r\n";
+const char reqBody[] PROGMEM = "Content-Type: application/json\r\nContent-Length: ";
+const char reqEnd[] PROGMEM = "\r\n\r\n";
+
+// build the Host and Connection headers, which only change when the server's
+// address or the keep-alive setting changes.
+void GroveStreams::_buildHeaders()
+{
+    char ip[16];
+    char conn[12];
+    ipToText(ip, serverIP);
+    _hdrKeepAlive = keepAlive;
+    strcpy_P(conn, keepAlive ? PSTR("keep-alive") : PSTR("close"));
+    _hdrLen = sprintf_P(_hdr, PSTR("Host: %s\r\nConnection: %s\r\n"), ip, conn);
+}
+
+// send the request line and headers. for a single send, the data goes in the
+// query string and there is no body. for a batch, determines the body length.
+// only the component ID, data and body length vary from one request to the next.
+void GroveStreams::_sendHeaders(gsConn& c)
+{
+    ethernetPacket packet(c.client, _arena);
+
+    if (_hdrKeepAlive != keepAlive) _buildHeaders();
+    packet.putFlash(reqPut);
+    packet.write_P( (PGM_P)_apiKey, _apiKeyLen );
+    if (c.batch) {
+        char len[8];
+        c.bodyLen = _putBatch(c, NULL);
+        c.bodySent = 0;
+        packet.putFlash(reqHTTP);
+        packet.write(_hdr, _hdrLen);
+        packet.putFlash(reqBody);
+        packet.write( len, strlen(ultoa(c.bodyLen, len, 10)) );
+        packet.putFlash(reqEnd);
+    }
+    else {
+        c.bodyLen = 0;
+        packet.putFlash(reqCompID);
+        packet.putChar(c.compID);
+        packet.putChar(c.data);
+        packet.putFlash(reqHTTP);
+        packet.write(_hdr, _hdrLen);
+        packet.putFlash(reqForwarded);
+        packet.putChar(c.compID);
+        packet.putFlash(reqNoBody);
+    }
+    packet.flush();
+    reqBytes = packet.bytes;
+    reqSegments = packet.segments;
+}
+
+// send the next slice of the batch body, at most SEND_SLICE characters.
+// returns true when the whole body has been sent.
+bool GroveStreams::_sendBody(gsConn& c)
+{
+    ethernetPacket packet(c.client, _arena);
+    uint16_t to = c.bodySent + SEND_SLICE;
+
+    _putBatch(c, &packet, c.bodySent, to);
+    packet.flush();
+    reqBytes += packet.bytes;
+    reqSegments += packet.segments;
+    c.bodySent = to < c.bodyLen ? to : c.bodyLen;
+    return c.bodySent >= c.bodyLen;
+}
+
+// the whole request has been sent, start waiting for the response
+ethernetStatus_t GroveStreams::_putComplete(gsConn& c)
+{
+    c.msPutComplete = millis();
+    GS_EVENT(EV_PUT_COMPLETE, reqBytes);
+    c.msLastPacket = c.msPutComplete;   // initialize receive timeout
+    if (c.batch) {
+        GS_INFO( F(" batch PUT complete ") << c.nSend << ' ' << c.bodyLen << endl );
+    }
+    else {
+        GS_INFO( F(" PUT complete ") << strlen(c.data) << endl );
+    }
+    batchSize = c.nSend;
+    bytesSent += reqBytes;
+    c.state = GS_RECV;
+    return PUT_COMPLETE;
+}
+
+#if GS_EVENTS > 0
+// record an event in the event log, overwriting the oldest if it is full
+void GroveStreams::_event(uint8_t code, uint16_t arg)
+{
+    uint8_t n = (_evHead + _nEvents) % GS_EVENTS;
+    if (_nEvents < GS_EVENTS) {
+        ++_nEvents;
+    }
+    else {
+        _evHead = (_evHead + 1) % GS_EVENTS;
+    }
+    _events[n].ms = millis();
+    _events[n].code = code;
+    _events[n].arg = arg;
+}
+#endif
+
+// print the event log, oldest event first, as "ms code arg" lines.
+// see gsEventCode_t for the codes. prints nothing if the log is disabled.
+void GroveStreams::dumpEvents(Print& out)
+{
+#if GS_EVENTS > 0
+    for (uint8_t i = 0; i < _nEvents; i++) {
+        const gsEvent& e = _events[(_evHead + i) % GS_EVENTS];
+        out << e.ms << ' ' << e.code << ' ' << e.arg << endl;
+    }
+#else
+    (void)out;
+#endif
+}
+
+// print the RAM used by each GroveStreams object, and by the arena that they
+// share, as set at compile time. stack use is not included.
+void GroveStreams::ramReport(Print& out)
+{
+    size_t hist = 0;
+#if GS_HISTOGRAMS
+    hist = sizeof(gsHistogram) * (4 + GS_PRIORITIES);
+#endif
+    size_t events = 0;
+#if GS_EVENTS > 0
+    events = sizeof(gsEvent) * GS_EVENTS;
+#endif
+    out << F("GroveStreams RAM: object ") << sizeof(GroveStreams)
+        << F(" (queue ") << sizeof(gsQueue)
+        << F(", connections ") << GS_MAX_CONN << 'x' << sizeof(gsConn)
+        << F(", histograms ") << hist
+        << F(", events ") << events
+        << F("), arena ") << sizeof(_arena)
+        << F(", total ") << sizeof(GroveStreams) + sizeof(_arena) << endl;
 }
 
 // convert an IPAddress to text
@@ -198,72 +1385,567 @@ void GroveStreams::ipToText(char* dest, IPAddress ip)
 int GroveStreams::dnsLookup(const char* hostname, IPAddress& addr)
 {
     int ret = 0;
+#if defined(GS_POSIX)
+    struct addrinfo hints;
+    struct addrinfo* res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    ret = getaddrinfo(hostname, NULL, &hints, &res);
+    if (ret == 0) {
+        const uint8_t* a = (const uint8_t*)&( (struct sockaddr_in*)res->ai_addr )->sin_addr.s_addr;
+        addr = IPAddress(a[0], a[1], a[2], a[3]);
+        freeaddrinfo(res);
+        ret = 1;
+    }
+#else
     DNSClient dns;
 
     dns.begin(Ethernet.dnsServerIP());
     ret = dns.getHostByName(hostname, addr);
+#endif
     return ret;
 }
 
-// reset the mcu
+// reset the mcu: on AVR with the watchdog, on ESP8266 and ESP32 with
+// ESP.restart(), and on ARM Cortex-M boards (SAMD, STM32, nRF52, RP2040,
+// Teensy, ...) with a system reset request, as CMSIS NVIC_SystemReset() does.
+// a host build has nothing to reset, so it exits and leaves restarting to
+// whatever started the program.
 void GroveStreams::mcuReset(uint32_t dly)
 {
     if ( dly > 4000 ) delay(dly - 4000);
     Serial << millis() << F(" Reset in");
+#if defined(__AVR__)
     wdt_enable(WDTO_4S);
     int countdown = 4;
     while (1) {
         Serial << ' ' << countdown--;
         delay(1000);
     }
+#else
+    for (int countdown = 4; countdown > 0; countdown--) {
+        Serial << ' ' << countdown;
+        delay(1000);
+    }
+    Serial << endl;
+    Serial.flush();
+#if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
+    ESP.restart();
+#elif defined(__ARM_ARCH_PROFILE) && __ARM_ARCH_PROFILE == 'M'
+    __asm__ volatile ("dsb" ::: "memory");
+    *(volatile uint32_t*)0xE000ED0CUL = 0x05FA0004UL;     // SCB->AIRCR = VECTKEY | SYSRESETREQ
+    __asm__ volatile ("dsb" ::: "memory");
+#else
+    exit(1);
+#endif
+    while (1) {}
+#endif
 }
 
-ethernetPacket::ethernetPacket(Client* client)
+// add an entry to the queue. returns false if the queue is full or there is
+// not enough contiguous space in the arena.
+bool gsQueue::put(const char* compID, const char* data)
 {
-    m_client = client;
-    _nchar = 0;
-    _next = _buf;
+    if ( !open(compID) ) return false;
+    append(data);
+    return close();
 }
 
-void ethernetPacket::putChar(const char* c)
+// start building an entry in place, in the largest contiguous free space in
+// the arena. the data is added with append(), and the entry is added to the
+// queue by close(). keep bytes of the space are left free, e.g. for a
+// send of higher priority. returns false if the queue is full.
+bool gsQueue::open(const char* compID, uint16_t keep)
 {
-    if (_nchar > 0) {   // if buffer not empty, back up one character to overlay the previous zero terminator
-        --_nchar;
-        --_next;
+    uint16_t room;
+    if (_count >= QUEUE_DEPTH) return false;
+    reserve(room, keep);
+    append(compID);
+    append('\0');
+    return true;
+}
+
+// start an entry that the caller will write directly, then add with
+// commit(). returns a pointer to the free space, less keep bytes, and its
+// size in room, or NULL if the queue or the arena is full.
+char* gsQueue::reserve(uint16_t& room, uint16_t keep)
+{
+    _openRoom = room = 0;
+    if (_count >= QUEUE_DEPTH) return NULL;
+    room = _free(_openPos);
+    _openRoom = room = room > keep ? room - keep : 0;
+    _openLen = 0;
+    _openFail = (room == 0);
+    return room > 0 ? _arena + _openPos : NULL;
+}
+
+// move the entry being built to the largest contiguous free space in the
+// arena, less keep bytes, if that is more than it has now, e.g. after older
+// entries have been removed. returns false if it was not moved.
+bool gsQueue::grow(uint16_t keep)
+{
+    if (_openRoom == 0 || _openFail) return false;
+    uint16_t pos;
+    uint16_t room = _count < QUEUE_DEPTH ? _free(pos) : 0;
+    room = room > keep ? room - keep : 0;
+    if (room <= _openRoom) return false;
+    memmove(_arena + pos, _arena + _openPos, _openLen + 1);
+    _openPos = pos;
+    _openRoom = room;
+    return true;
+}
+
+// find the largest contiguous free space in the arena. returns its size,
+// and its arena offset in pos.
+uint16_t gsQueue::_free(uint16_t& pos)
+{
+    if (_count == 0) {
+        pos = 0;            // queue is empty, start over at the beginning of the arena
+        return QUEUE_ARENA;
+    }
+
+    // entries must be contiguous. free space is either [_wr, head) or
+    // [_wr, end) plus [0, head). a new entry must end short of the
+    // head so that _wr never catches up to it.
+    uint16_t head = _offset[_head];
+    pos = _wr;
+    if (pos < head) return head - pos - 1;
+    if (head > QUEUE_ARENA - pos + 1) {
+        pos = 0;
+        return head - 1;
+    }
+    return QUEUE_ARENA - pos;
+}
+
+// add a character to the entry being built. the entry is kept terminated,
+// and if it does not fit, close() will fail.
+void gsQueue::append(char c)
+{
+    if (_openLen + 1 < _openRoom) {
+        char* p = _arena + _openPos + _openLen++;
+        p[0] = c;
+        p[1] = '\0';
     }
-    while ( (*_next++ = *c++) ) {       // copy the next character
-        if (++_nchar >= PKTSIZE - 1) {  // if only one byte left
-            *_next++ = 0;               // put in the terminator
-            ++_nchar;                   // and count it
-            flush();                    // send the buffer
+    else {
+        _openFail = true;
+    }
+}
+
+// add a decimal number to the entry being built, with a decimal point before
+// the last decimals digits, e.g. (-5, 2) gives "-0.05". the digits are
+// written last first, then reversed in place.
+void gsQueue::appendNumber(int32_t value, uint8_t decimals)
+{
+    uint32_t u = value < 0 ? 0 - (uint32_t)value : value;
+    if (value < 0) append('-');
+
+    uint16_t start = _openLen;
+    uint8_t nDigits = 0;
+    do {
+        if (nDigits == decimals && decimals > 0) append('.');
+        append( '0' + u % 10 );
+        u /= 10;
+        ++nDigits;
+    } while (u > 0 || nDigits <= decimals);
+
+    if (_openLen > start) {
+        char* p = _arena + _openPos;
+        for (uint16_t i = start, j = _openLen - 1; i < j; i++, j--) {
+            char t = p[i];
+            p[i] = p[j];
+            p[j] = t;
         }
     }
-    ++_nchar;                           // count the terminator
 }
 
-void ethernetPacket::putChar(const __FlashStringHelper *f)
+// add the entry being built to the queue. returns false if there is none,
+// or if it did not fit.
+bool gsQueue::close(uint8_t flags)
 {
-    const char *c = (const char PROGMEM *)f;
+    if (_openRoom == 0 || _openFail) {
+        _openRoom = 0;
+        return false;
+    }
+    uint8_t n = (_head + _count) % QUEUE_DEPTH;
+    _offset[n] = _openPos;
+    _msPut[n] = millis();
+    _owner[n] = WAITING;
+    _flags[n] = flags;
+    _wr = _openPos + _openLen + 1;
+    _openRoom = 0;
+    ++_count;
+    return true;
+}
 
-    if (_nchar > 0) {   // if buffer not empty, back up one character to overlay the previous zero terminator
-        --_nchar;
-        --_next;
+// get pointers to the component ID and data of the n-th oldest entry, without
+// removing it. returns false if there is no such entry.
+bool gsQueue::peek(const char*& compID, const char*& data, uint8_t n)
+{
+    if (n >= _count) return false;
+    compID = _arena + _offset[(_head + n) % QUEUE_DEPTH];
+    data = compID + strlen(compID) + 1;
+    return true;
+}
+
+// remove the oldest entry
+void gsQueue::pop()
+{
+    if (_count > 0) {
+        _head = (_head + 1) % QUEUE_DEPTH;
+        --_count;
     }
-    while ( (*_next++ = pgm_read_byte(c++)) ) { // copy the next character
-        if (++_nchar >= PKTSIZE - 1) {          // if only one byte left
-            *_next++ = 0;                       // put in the terminator
-            ++_nchar;                           // and count it
-            flush();                            // send the buffer
+}
+
+// mark the entries owned by a connection as done, then remove done entries
+// from the front of the queue. entries sent on different connections can
+// finish in any order, so some may wait for an older entry to finish
+// before they are removed. release(DONE) just does the removal. returns
+// the number of entries marked.
+uint8_t gsQueue::release(uint8_t owner)
+{
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+        uint8_t& o = _owner[(_head + i) % QUEUE_DEPTH];
+        if (o == owner) {
+            o = DONE;
+            ++n;
+        }
+    }
+    while (_count > 0 && _owner[_head] == DONE) pop();
+    return n;
+}
+
+void batchWriter::put(const __FlashStringHelper* f)
+{
+    PGM_P p = (PGM_P)f;
+    uint16_t len = strlen_P(p);
+
+    if (_packet && n < _to && n + len > _from) {
+        if (n >= _from && n + len <= _to) {
+            _packet->putChar(f);
+        }
+        else {
+            for (uint16_t i = 0; i < len; i++) {
+                if (n + i >= _from && n + i < _to) _packet->putChar( (char)pgm_read_byte(p + i) );
+            }
+        }
+    }
+    n += len;
+}
+
+// write a url-encoded field from the query string as a JSON string
+void batchWriter::putString(const char* s, const char* end)
+{
+    put('"');
+    while (s < end) {
+        char c = *s++;
+        if (c == '+') {
+            c = ' ';
+        }
+        else if (c == '%' && end - s >= 2 && isxdigit(s[0]) && isxdigit(s[1])) {
+            char hex[3] = { s[0], s[1], 0 };
+            c = strtol(hex, NULL, 16);
+            s += 2;
+        }
+        if (c == '"' || c == '\\') put('\\');
+        put( (uint8_t)c < ' ' ? ' ' : c );
+    }
+    put('"');
+}
+
+// write a field from the query string as a JSON number if it looks like one,
+// else as a string
+void batchWriter::putValue(const char* s, const char* end)
+{
+    const char* p = s;
+    bool digits = false;
+
+    if (p < end && *p == '-') ++p;
+    while (p < end && isdigit(*p)) { ++p; digits = true; }
+    if (p < end && *p == '.') {
+        ++p;
+        while (p < end && isdigit(*p)) { ++p; digits = true; }
+    }
+    if (digits && p == end) {
+        while (s < end) put(*s++);
+    }
+    else {
+        putString(s, end);
+    }
+}
+
+// count a time in its bucket
+void gsHistogram::add(uint32_t ms)
+{
+    uint8_t k = 0;
+    while (ms > 0 && k < HIST_BUCKETS - 1) {
+        ms >>= 1;
+        ++k;
+    }
+    if (bucket[k] < 0xFFFF) ++bucket[k];
+}
+
+// total number of times counted
+uint32_t gsHistogram::count() const
+{
+    uint32_t n = 0;
+    for (uint8_t k = 0; k < HIST_BUCKETS; k++) n += bucket[k];
+    return n;
+}
+
+// returns the upper bound of the bucket containing the p-th percentile,
+// i.e. p percent of the times were no more than this. returns 0 if empty,
+// 65535 if in the last bucket.
+uint16_t gsHistogram::percentile(uint8_t p) const
+{
+    uint32_t n = count();
+    if (n == 0) return 0;
+
+    uint32_t target = (n * p + 99) / 100;   // rank of the percentile, rounded up
+    uint32_t sum = 0;
+    for (uint8_t k = 0; k < HIST_BUCKETS - 1; k++) {
+        sum += bucket[k];
+        if (sum >= target) return (1U << k) - 1;
+    }
+    return 0xFFFF;
+}
+
+// prepare to parse a new response
+void gsHttpParser::begin()
+{
+    status = 0;
+    contentLength = -1;
+    chunked = false;
+    close = false;
+    complete = false;
+    date = 0;
+    retryAfter = -1;
+    rateRemaining = -1;
+    _state = P_STATUS;
+    _lineLen = 0;
+    _left = 0;
+}
+
+// process the next len characters of the response. may be called with any
+// amount of data, parsing resumes where it left off. body data is skipped
+// over without being copied. stops at the end of the response, and returns
+// the number of characters consumed.
+uint16_t gsHttpParser::parse(const uint8_t* buf, uint16_t len)
+{
+    uint16_t i = 0;
+
+    while (i < len && _state != P_DONE) {
+        if (_state == P_BODY || _state == P_CHUNK_DATA) {
+            uint32_t n = len - i;
+            if (n > _left) n = _left;
+            i += n;
+            _left -= n;
+            if (_left == 0) _state = (_state == P_BODY) ? P_DONE : P_CHUNK_END;
+        }
+        else if (_state == P_UNTIL_CLOSE) {
+            i = len;
+        }
+        else {
+            char c = buf[i++];
+            if (c == '\n') {
+                _line[_lineLen] = 0;
+                _parseLine();
+                _lineLen = 0;
+            }
+            else if (c != '\r' && _lineLen < sizeof(_line) - 1) {
+                _line[_lineLen++] = c;      // long lines are truncated
+            }
+        }
+    }
+    complete = (_state == P_DONE);
+    return i;
+}
+
+// process a complete line of the response (status line, header, chunk size, etc.)
+void gsHttpParser::_parseLine()
+{
+    switch (_state)
+    {
+    case P_STATUS:      // e.g. "HTTP/1.1 200 OK"
+        {
+            const char* p = strchr(_line, ' ');
+            status = p ? atoi(p + 1) : 0;
+            if (strncmp_P(_line, PSTR("HTTP/1.0"), 8) == 0) close = true;
+            _state = P_HEADER;
         }
+        break;
+
+    case P_HEADER:
+        if (_lineLen > 0) {
+            _parseHeader();
+        }
+        else if (status >= 100 && status < 200) {
+            _state = P_STATUS;      // interim response, the real one follows
+        }
+        else if (chunked) {
+            _state = P_CHUNK_SIZE;
+        }
+        else if (contentLength > 0) {
+            _left = contentLength;
+            _state = P_BODY;
+        }
+        else if (contentLength == 0) {
+            _state = P_DONE;
+        }
+        else {
+            close = true;           // no length given, the body ends when the server closes
+            _state = P_UNTIL_CLOSE;
+        }
+        break;
+
+    case P_CHUNK_SIZE:  // hex chunk size, possibly followed by extensions
+        _left = strtoul(_line, NULL, 16);
+        _state = _left > 0 ? P_CHUNK_DATA : P_TRAILER;
+        break;
+
+    case P_CHUNK_END:   // the line ending after the chunk data
+        _state = P_CHUNK_SIZE;
+        break;
+
+    case P_TRAILER:
+        if (_lineLen == 0) _state = P_DONE;
+        break;
+
+    default:
+        break;
+    }
+}
+
+// convert an HTTP Date header, e.g. "Fri, 16 Oct 2026 12:00:00 GMT", to
+// seconds since 1970. returns zero if it cannot be read.
+uint32_t gsHttpParser::_parseDate(const char* date)
+{
+    static const char months[] PROGMEM = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    const char* p = strchr(date, ',');
+    char* e;
+
+    if (p == NULL) return 0;
+    uint8_t d = strtoul(p + 1, &e, 10);
+    while (*e == ' ') ++e;
+    uint8_t m = 0;
+    while (m < 12 && strncmp_P(e, months + 3 * m, 3) != 0) ++m;
+    if (m >= 12) return 0;
+    ++m;
+    uint16_t y = strtoul(e + 3, &e, 10);
+    uint32_t hh = strtoul(e, &e, 10);
+    uint32_t mm = strtoul(e + 1, &e, 10);
+    uint32_t ss = strtoul(e + 1, &e, 10);
+    if (y < 1970 || d < 1 || d > 31) return 0;
+
+    // days since 1970-01-01, see http://howardhinnant.github.io/date_algorithms.html
+    uint16_t yy = y - (m <= 2);
+    uint16_t era = yy / 400;
+    uint16_t yoe = yy - era * 400;
+    uint16_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    uint32_t doe = yoe * 365UL + yoe / 4 - yoe / 100 + doy;
+    uint32_t days = era * 146097UL + doe - 719468UL;
+    return days * 86400UL + hh * 3600 + mm * 60 + ss;
+}
+
+// pick out the headers of interest
+void gsHttpParser::_parseHeader()
+{
+    char* v = strchr(_line, ':');
+    if (v == NULL) return;
+    *v++ = 0;
+    while (*v == ' ') ++v;
+
+    if (strcasecmp_P(_line, PSTR("Content-Length")) == 0) {
+        contentLength = atol(v);
+    }
+    else if (strcasecmp_P(_line, PSTR("Transfer-Encoding")) == 0) {
+        chunked = (strncasecmp_P(v, PSTR("chunked"), 7) == 0);
+    }
+    else if (strcasecmp_P(_line, PSTR("Connection")) == 0) {
+        close = (strncasecmp_P(v, PSTR("close"), 5) == 0);
+    }
+    else if (strcasecmp_P(_line, PSTR("Date")) == 0) {
+        date = _parseDate(v);
+    }
+    else if (strcasecmp_P(_line, PSTR("Retry-After")) == 0) {
+        retryAfter = atol(v);
+    }
+    else if (strcasecmp_P(_line, PSTR("X-RateLimit-Remaining")) == 0) {
+        rateRemaining = atol(v);
+    }
+}
+
+// build a packet for the client in buf, which must have room for PKTSIZE
+// characters
+ethernetPacket::ethernetPacket(Client* client, char* buf)
+{
+    m_client = client;
+    _buf = buf;
+    _nchar = 0;
+    bytes = 0;
+    segments = 0;
+}
+
+void ethernetPacket::putChar(const char* c)
+{
+    write(c, strlen(c));
+}
+
+void ethernetPacket::putChar(const __FlashStringHelper *f)
+{
+    write_P( (PGM_P)f, strlen_P((PGM_P)f) );
+}
+
+// copy len characters from flash into the packet, a buffer-full at a time
+void ethernetPacket::write_P(PGM_P c, uint16_t len)
+{
+    while (len > 0) {
+        if (_nchar >= PKTSIZE) flush();
+        uint16_t n = PKTSIZE - _nchar;
+        if (n > len) n = len;
+        memcpy_P(_buf + _nchar, c, n);
+        _nchar += n;
+        c += n;
+        len -= n;
+    }
+}
+
+void ethernetPacket::putChar(char c)
+{
+    if (_nchar >= PKTSIZE) flush();
+    _buf[_nchar++] = c;
+}
+
+// add len characters from RAM to the packet. if they fit in the buffer, they
+// are copied. otherwise, large blocks are written directly to the client
+// after the buffer is sent, rather than being copied.
+void ethernetPacket::write(const char* buf, uint16_t len)
+{
+    if (len > PKTSIZE - _nchar && len >= PKTSIZE / 2) {
+        flush();
+        m_client->write( (const uint8_t*)buf, len );
+        bytes += len;
+        ++segments;
+        return;
+    }
+    while (len > 0) {
+        if (_nchar >= PKTSIZE) flush();
+        uint16_t n = PKTSIZE - _nchar;
+        if (n > len) n = len;
+        memcpy(_buf + _nchar, buf, n);
+        _nchar += n;
+        buf += n;
+        len -= n;
     }
-    ++_nchar;                                   // count the terminator
 }
 
 void ethernetPacket::flush()
 {
     if (_nchar > 0) {
-        m_client->print(_buf);
+        m_client->write( (const uint8_t*)_buf, _nchar );
+        bytes += _nchar;
+        ++segments;
         _nchar = 0;
-        _next = _buf;
     }
 }
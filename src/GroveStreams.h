@@ -6,83 +6,555 @@
 #ifndef GROVESTREAMS_H_INCLUDED
 #define GROVESTREAMS_H_INCLUDED
 
+// define GS_POSIX when compiling the library for Linux or another POSIX
+// host with an Arduino API core, e.g. -DGS_POSIX. the server's address is
+// then looked up with getaddrinfo() rather than the Ethernet library, and
+// any Client can be used, e.g. gsPosixClient (gsPosixClient.h).
 #include <Arduino.h>
+#if defined(__AVR__)
 #include <avr/wdt.h>
+#endif
+#if defined(GS_POSIX)
+#include <Client.h>
+#else
 #include <Dns.h>
 #include <Ethernet.h>
+#endif
 #include <Streaming.h>      // https://github.com/janelia-arduino/Streaming
 
 enum ethernetStatus_t
 {
     NO_STATUS, SEND_ACCEPTED, PUT_COMPLETE, DISCONNECTING, DISCONNECTED, HTTP_OK,
-    SEND_BUSY, CONNECT_FAILED, TIMEOUT, HTTP_OTHER
+    SEND_BUSY, CONNECT_FAILED, TIMEOUT, HTTP_OTHER, SEND_SHED,
+    BREAKER_OPEN, BREAKER_HALF_OPEN, BREAKER_CLOSED
+};
+
+// circuit breaker states. while open, no requests are made. after a
+// backoff delay it is half open, and one trial request is made.
+enum gsBreaker_t
+{
+    GS_BREAKER_CLOSED, GS_BREAKER_OPEN, GS_BREAKER_HALF_OPEN
 };
 
-const uint8_t MAX_ERROR(5);             // reset mcu after this many consecutive errors
+// send priorities. urgent sends, e.g. alarms, are sent ahead of bulk data,
+// and have queue space that bulk data cannot use.
+enum gsPriority_t
+{
+    GS_BULK, GS_URGENT
+};
+const uint8_t GS_PRIORITIES(2);         // number of priorities
+
+// logging levels. GS_LOG_LEVEL is the most detailed level compiled into the
+// library, define it as GS_LOG_NONE (e.g. -DGS_LOG_LEVEL=0) to remove all
+// logging code and text.
+#define GS_LOG_NONE 0
+#define GS_LOG_ERROR 1
+#define GS_LOG_INFO 2
+#ifndef GS_LOG_LEVEL
+#define GS_LOG_LEVEL GS_LOG_INFO
+#endif
+
+// size of the binary event log, zero for none (e.g. -DGS_EVENTS=16 to enable)
+#ifndef GS_EVENTS
+#define GS_EVENTS 0
+#endif
+
+// maximum number of clients in a connection pool (e.g. -DGS_MAX_CONN=4 to
+// use four of the W5100's sockets). each one costs about 130 bytes of RAM.
+#ifndef GS_MAX_CONN
+#define GS_MAX_CONN 1
+#endif
+
+// boards with 2K of RAM or less, e.g. the ATmega328, get smaller defaults
+// for the sizes below, and no histograms or statistics snapshot.
+#if defined(RAMEND) && RAMEND < 0x900
+#define GS_SMALL_RAM
+#endif
+
+// sizes of the queue, the packet buffer and the response line buffer, which
+// can be changed to suit the board (e.g. -DGS_QUEUE_DEPTH=8
+// -DGS_QUEUE_ARENA=256). the packet buffer is a single static arena, shared
+// by all GroveStreams objects, used both to write requests and to read
+// responses. see GroveStreams::ramReport().
+#ifndef GS_QUEUE_DEPTH
+#if defined(GS_SMALL_RAM)
+#define GS_QUEUE_DEPTH 4
+#else
+#define GS_QUEUE_DEPTH 6
+#endif
+#endif
+#ifndef GS_QUEUE_ARENA
+#if defined(GS_SMALL_RAM)
+#define GS_QUEUE_ARENA 128
+#else
+#define GS_QUEUE_ARENA 192
+#endif
+#endif
+#ifndef GS_PKTSIZE
+#if defined(GS_SMALL_RAM)
+#define GS_PKTSIZE 128
+#else
+#define GS_PKTSIZE 300
+#endif
+#endif
+// per connection. the Date header needs 36 characters.
+#ifndef GS_HTTP_LINE
+#define GS_HTTP_LINE 40
+#endif
+
+// 1 to compile in the latency histograms (connHist, respHist, discHist,
+// queueHist and prioHist), about 170 bytes of RAM, and snapshot(), 0 to
+// leave them out (e.g. -DGS_HISTOGRAMS=1 -DGS_STATS=1 on a small board).
+#ifndef GS_HISTOGRAMS
+#if defined(GS_SMALL_RAM)
+#define GS_HISTOGRAMS 0
+#else
+#define GS_HISTOGRAMS 1
+#endif
+#endif
+#ifndef GS_STATS
+#if defined(GS_SMALL_RAM)
+#define GS_STATS 0
+#else
+#define GS_STATS 1
+#endif
+#endif
+
+// TCP port of the server (e.g. -DGS_SERVER_PORT=8080 for a test server)
+#ifndef GS_SERVER_PORT
+#define GS_SERVER_PORT 80
+#endif
+
+enum gsEventCode_t
+{
+    EV_CONNECT, EV_CONNECTED, EV_CONNECT_FAIL, EV_PUT_COMPLETE, EV_HTTP_STATUS,
+    EV_RECV_TIMEOUT, EV_STALE, EV_SERVER_CLOSE, EV_IDLE_CLOSE, EV_DISCONNECTED,
+    EV_DNS_OK, EV_DNS_FAIL, EV_SEND_BUSY, EV_BREAKER
+};
+
+struct gsEvent
+{
+    uint32_t ms;                // millis() when the event occurred
+    uint8_t code;               // gsEventCode_t
+    uint16_t arg;               // e.g. HTTP status, elapsed ms, byte count
+};
+
+const uint8_t MAX_ERROR(5);             // default consecutive errors to open the circuit breaker
+const uint32_t BACKOFF_MIN(1000);       // default ms to wait after the first error
+const uint32_t BACKOFF_MAX(300000);     // default maximum ms to wait between attempts
+const uint32_t RESET_AFTER(3600000);    // default ms the circuit breaker can stay open before the mcu is reset
+const uint8_t PUT_BURST(12);            // default and maximum PUTs in any window of PUT_BURST x PUT_INTERVAL ms, i.e. 12 in two minutes as GroveStreams allows
+const uint32_t PUT_INTERVAL(10000);     // default ms per PUT over the long run, the GroveStreams limit
 const uint32_t RECEIVE_TIMEOUT(8000);   // ms to wait for response from server
-const int serverPort(80);               // http port
+const uint32_t IDLE_TIMEOUT(30000);     // default ms to keep an idle keep-alive connection open
+const uint32_t DNS_REFRESH(3600000);    // default ms between DNS lookups of the server address
+const uint32_t DNS_RETRY(10000);        // ms between DNS lookups after a failure
+const int serverPort(GS_SERVER_PORT);   // http port
+const uint8_t QUEUE_DEPTH(GS_QUEUE_DEPTH);      // maximum number of sends waiting to be transmitted
+const uint16_t QUEUE_ARENA(GS_QUEUE_ARENA);     // bytes of storage for queued component IDs and data
+const uint16_t PKTSIZE(GS_PKTSIZE);     // bytes in the arena for writing requests and reading responses
+const uint8_t URGENT_RESERVE(1);        // default queue entries that only urgent sends can use
+const uint8_t URGENT_MAX(4);            // default PUTs in a row that can serve urgent sends first while bulk sends wait
+const uint16_t BATCH_BYTES(1024);       // default maximum JSON body size for a batch PUT
+const uint16_t SEND_SLICE(256);         // maximum body characters sent per call to run()
+const uint16_t RECV_MAX(256);           // maximum response characters read per call to run()
+const uint8_t HTTP_LINE(GS_HTTP_LINE);  // response lines longer than this are truncated
+const uint32_t REPLAY_INTERVAL(10000);  // default ms between replays of stored sends
+const uint32_t DRIFT_INTERVAL(21600000);    // minimum ms between updates of the clock drift estimate
+const int32_t MAX_DRIFT(20000);         // largest clock drift correction, ppm
+const int32_t CLOCK_STEP(60000);        // clock errors of this many ms or more are corrected at once, not counted as drift
+
+// incremental parser for the server's HTTP responses. data can be given to
+// it in pieces of any size. it finds the status code, the headers of
+// interest, and the end of the response.
+class gsHttpParser
+{
+public:
+    gsHttpParser() { begin(); }
+    void begin();
+    uint16_t parse(const uint8_t* buf, uint16_t len);
+    bool haveStatus() const { return _state != P_STATUS && (status < 100 || status >= 200); }   // final (not 1xx) status received
+    bool haveHeaders() const { return _state != P_STATUS && _state != P_HEADER && haveStatus(); }   // and all its headers
+
+    uint16_t status;            // HTTP status code
+    int32_t contentLength;      // Content-Length header, -1 if none
+    bool chunked;               // chunked transfer encoding
+    bool close;                 // the server will close the connection after the response
+    bool complete;              // the whole response has been received
+    uint32_t date;              // Date header, seconds since 1970, zero if none
+    int32_t retryAfter;         // Retry-After header in seconds, -1 if none
+    int32_t rateRemaining;      // X-RateLimit-Remaining header, -1 if none
+
+private:
+    void _parseLine();
+    void _parseHeader();
+    static uint32_t _parseDate(const char* date);
+
+    enum parseState_t
+    {
+        P_STATUS, P_HEADER, P_BODY, P_UNTIL_CLOSE, P_CHUNK_SIZE, P_CHUNK_DATA,
+        P_CHUNK_END, P_TRAILER, P_DONE
+    };
+    parseState_t _state;
+    char _line[HTTP_LINE];      // the line being received
+    uint8_t _lineLen;
+    uint32_t _left;             // body or chunk characters still to come
+};
+
+// fixed-capacity queue of sends waiting for transmission. component IDs and
+// data are copied into a statically allocated arena, so the caller's buffers
+// need not persist after send() returns. an entry can also be built in place
+// with open(), append() and close(), so that it needs no other buffer.
+class gsQueue
+{
+public:
+    gsQueue() : _head(0), _count(0), _wr(0), _openPos(0), _openLen(0), _openRoom(0), _openFail(false) {}
+    bool put(const char* compID, const char* data);
+    bool open(const char* compID, uint16_t keep = 0);
+    void append(char c);
+    void append(const char* s) { while (*s) append(*s++); }
+    void appendNumber(int32_t value, uint8_t decimals = 0);
+    bool close(uint8_t flags = 0);
+    char* reserve(uint16_t& room, uint16_t keep = 0);
+    bool commit(uint16_t len, uint8_t flags = 0) { _openLen = len - 1; return close(flags); }
+    void abandon() { _openRoom = 0; }
+    bool isOpen() { return _openRoom > 0; }
+    uint16_t openFree() { return _openRoom > _openLen + 1 ? _openRoom - _openLen - 1 : 0; }   // characters that can still be appended
+    bool grow(uint16_t keep = 0);
+    const char* openEntry() { return _arena + _openPos; }  // component ID of the entry being built, then its data
+    bool peek(const char*& compID, const char*& data, uint8_t n = 0);
+    void pop();
+    uint8_t release(uint8_t owner);
+    uint8_t count() { return _count; }
+    uint32_t timeQueued(uint8_t n = 0) { return _msPut[(_head + n) % QUEUE_DEPTH]; }
+    uint8_t owner(uint8_t n) { return _owner[(_head + n) % QUEUE_DEPTH]; }
+    void setOwner(uint8_t n, uint8_t owner) { _owner[(_head + n) % QUEUE_DEPTH] = owner; }
+    uint8_t flags(uint8_t n) { return _flags[(_head + n) % QUEUE_DEPTH]; }
+    uint16_t room() { uint16_t pos; return _count < QUEUE_DEPTH ? _free(pos) : 0; }
+
+    static const uint8_t WAITING = 0;   // owner of an entry not yet being sent
+    static const uint8_t DONE = 0xFF;   // owner of an entry that can be removed
+    static const uint8_t REPLAY = 1;    // flag for an entry read back from a gsStore
+    static const uint8_t URGENT = 2;    // flag for an entry with priority GS_URGENT
+
+private:
+    uint16_t _free(uint16_t& pos);
+
+    uint16_t _offset[QUEUE_DEPTH];  // arena offset of each entry (component ID, then data)
+    uint32_t _msPut[QUEUE_DEPTH];   // millis() when each entry was queued
+    uint8_t _owner[QUEUE_DEPTH];    // connection sending each entry, or WAITING or DONE
+    uint8_t _flags[QUEUE_DEPTH];
+    char _arena[QUEUE_ARENA];
+    uint8_t _head;                  // index of the oldest entry
+    uint8_t _count;                 // number of entries in the queue
+    uint16_t _wr;                   // arena offset where the next entry will be written
+    uint16_t _openPos;              // arena offset of the entry being built
+    uint16_t _openLen;              // characters in the entry being built
+    uint16_t _openRoom;             // space for the entry being built, zero if none
+    bool _openFail;                 // the entry being built did not fit
+};
+
+const uint8_t HIST_BUCKETS(14);         // histogram buckets: 0, 1, 2-3, 4-7, ... 2048-4095, 4096+ ms
+const uint32_t DIAG_INTERVAL(3600000);  // default ms between diagnostic reports
+
+// log-bucketed histogram of times in milliseconds. bucket 0 counts zeros,
+// bucket k counts times in [2^(k-1), 2^k), and the last bucket counts
+// everything larger. counts stop at 65535 rather than wrapping.
+class gsHistogram
+{
+public:
+    void add(uint32_t ms);
+    uint32_t count() const;
+    uint16_t percentile(uint8_t p) const;
+    void reset() { memset(bucket, 0, sizeof(bucket)); }
+
+    uint16_t bucket[HIST_BUCKETS] {};
+};
+
+// a copy of the statistics at one point in time, see GroveStreams::snapshot()
+struct gsStats
+{
+    uint32_t ms;                // millis() when the snapshot was taken
+    uint32_t sendSeq;
+    uint32_t sendBusy;
+    uint32_t sendShed;
+    uint32_t breakerTrips;
+    uint32_t putDeferred;
+    uint32_t sendOK;
+    uint32_t sendLost;
+    uint32_t httpOK;
+    uint32_t httpOther;
+    uint32_t connFail;
+    uint32_t recvTimeout;
+    uint32_t dnsFail;
+    uint32_t connReused;
+    uint32_t reconnects;
+    uint32_t bytesSent;
+    uint32_t runTimeMax;
+    uint8_t queueMax;
+    uint32_t backlog;
+    uint32_t stored;
+    uint32_t replayed;
+    uint32_t prioOK[GS_PRIORITIES];
+    uint32_t prioDropped[GS_PRIORITIES];
+#if GS_HISTOGRAMS
+    gsHistogram connHist;
+    gsHistogram respHist;
+    gsHistogram discHist;
+    gsHistogram queueHist;
+    gsHistogram prioHist[GS_PRIORITIES];
+#endif
+};
+
+enum gsState_t
+{
+    GS_WAIT, GS_CONNECT, GS_SEND_HEADERS, GS_SEND_BODY, GS_RECV, GS_DISCONNECT
+};
+
+// storage for sends that cannot be transmitted now, e.g. while the network
+// is down, so that they can be sent later. a record is a component ID and
+// its data. records are read back oldest first. see gsSdStore.h,
+// gsEepromStore.h and gsFileStore.h.
+class gsStore
+{
+public:
+    // add a record. its data is data followed by more. returns false if there is no room.
+    virtual bool append(const char* compID, const char* data, const char* more) = 0;
+    // copy the oldest record to buf as "compID\0data\0" and return its length,
+    // including both terminators. returns zero if there are no records, and
+    // if the length is more than size, buf is not valid.
+    virtual uint16_t peek(char* buf, uint16_t size) = 0;
+    // remove the oldest record
+    virtual void pop() = 0;
+    // number of records stored
+    virtual uint32_t count() = 0;
+};
+
+// one connection to the server and the request in progress on it
+struct gsConn
+{
+    Client* client {NULL};
+    uint8_t id {0};             // owner of the queued sends in its PUT, 1 to GS_MAX_CONN
+    gsState_t state {GS_WAIT};
+    bool open {false};          // client is connected to the server
+    const char* compID {NULL};  // component ID for a single send (points into the queue)
+    const char* data {NULL};
+    uint8_t nSend {0};          // number of queued sends in the PUT in progress
+    bool batch {false};         // the PUT in progress has a JSON body
+    uint16_t bodyLen {0};       // length of the request body being sent
+    uint16_t bodySent {0};      // number of body characters sent so far
+    uint16_t requests {0};      // number of requests sent on this connection
+    uint8_t putSlot {0};        // the PUT in progress's entry in the rate limit window
+    unsigned long msConnect {0};
+    unsigned long msPutComplete {0};
+    unsigned long msLastPacket {0};
+    unsigned long msIdle {0};   // time the keep-alive connection became idle
+    gsHttpParser http;          // parser for the server's response
+};
+
+class batchWriter;
+class ethernetPacket;
 
 class GroveStreams
 {
 public:
     GroveStreams(Client& client, const char* server, const __FlashStringHelper* apiKey, int ledPin=-1)
-        : m_client(&client), _serverName(server), _apiKey(apiKey), _ledPin(ledPin) {}
+        : _serverName(server), _apiKey(apiKey), _nConn(1), _ledPin(ledPin) { _conn[0].client = &client; _conn[0].id = 1; }
+    GroveStreams(Client* const* clients, uint8_t nClients, const char* server, const __FlashStringHelper* apiKey, int ledPin=-1);
     void begin();
-    ethernetStatus_t send(const char* compID, const char* data);
+    ethernetStatus_t send(const char* compID, const char* data, gsPriority_t priority = GS_BULK);
+    bool sendBegin(const char* compID, gsPriority_t priority = GS_BULK);
+    void addInt(const char* id, int32_t value) { addFixed(id, value, 0); }
+    void addFixed(const char* id, int32_t value, uint8_t decimals);
+    void addFloat(const char* id, float value, uint8_t decimals);
+    void addString(const char* id, const char* value);
+    void addData(const char* data);
+    ethernetStatus_t sendEnd();
+    uint16_t maxData(const char* compID, gsPriority_t priority = GS_BULK);
     ethernetStatus_t run();
+    uint8_t tokens();
+    uint32_t now();
+    const gsHttpParser& response() { return _conn[_lastConn].http; }
+#if GS_STATS
+    void snapshot(gsStats& s);
+#endif
+    void resetStats();
+    void dumpEvents(Print& out);
     void mcuReset(uint32_t dly = 0 );
+    static void ramReport(Print& out);
     void ipToText(char* dest, IPAddress ip);
 
     IPAddress serverIP;
-    ethernetStatus_t lastStatus;
+    ethernetStatus_t lastStatus {NO_STATUS};
     bool bypassMode {false};
+    uint8_t logLevel {GS_LOG_INFO};     // GS_LOG_NONE, GS_LOG_ERROR or GS_LOG_INFO (limited by GS_LOG_LEVEL)
+    uint32_t batchWindow {0};           // ms to collect sends into a single batch PUT, zero to send each one individually
+    uint16_t batchBytes {BATCH_BYTES};  // maximum JSON body size for a batch PUT
+    bool keepAlive {false};             // keep the connection open between PUTs
+    uint32_t idleTimeout {IDLE_TIMEOUT};    // ms to keep an idle keep-alive connection open
+    uint32_t dnsRefresh {DNS_REFRESH};      // ms between DNS lookups to refresh serverIP
+    const char* diagCompID {NULL};          // component to send diagnostic reports to, NULL for none
+    uint32_t diagInterval {DIAG_INTERVAL};  // ms between diagnostic reports
+    gsStore* store {NULL};                  // storage for sends that cannot be transmitted, NULL for none
+    uint32_t replayInterval {REPLAY_INTERVAL};  // ms between replays of stored sends
+    uint32_t backoffMin {BACKOFF_MIN};      // ms to wait after the first error, doubled after each further error
+    uint32_t backoffMax {BACKOFF_MAX};      // maximum ms to wait between attempts
+    uint8_t breakerThreshold {MAX_ERROR};   // consecutive errors to open the circuit breaker
+    uint32_t resetAfter {RESET_AFTER};      // ms the circuit breaker can stay open before the mcu is reset, zero for never
+    uint8_t putBurst {PUT_BURST};           // PUTs allowed in any window of putBurst x putInterval ms, at most PUT_BURST
+    uint32_t putInterval {PUT_INTERVAL};    // ms per PUT over the long run, zero for no limit
+    bool timeStamp {false};                 // add the time to each send when it is queued, once the server time is known
+    int32_t clockDrift {0};                 // correction to millis() in ppm, estimated from the server time
+    uint8_t urgentReserve {URGENT_RESERVE}; // queue entries, and a quarter of the queue's storage, that only urgent sends can use
+    uint8_t urgentMax {URGENT_MAX};         // PUTs in a row that can serve urgent sends first while bulk sends wait, zero for no limit
 
     // web posting stats
-    uint16_t httpOK;            // number of HTTP OK responses received
-    uint8_t nError;             // error count since last httpOK (SEND_BUSY, CONNECT_FAILED, TIMEOUT, HTTP_OTHER)
-    uint16_t sendSeq;           // number of sends requested
-    uint16_t sendBusy;          // number of sends rejected
-    uint16_t connFail;          // number of connection failures
-    uint16_t recvTimeout;       // number of timeouts waiting for server response
-    uint16_t httpOther;         // number of non-OK HTTP responses received (i.e. not HTTP status 200)
-    uint32_t connTime;          // time to connect to server in milliseconds
-    uint32_t respTime;          // response time in milliseconds
-    uint32_t discTime;          // time to disconnect from server in milliseconds
+    uint32_t httpOK {0};        // number of HTTP OK responses received
+    uint8_t nError {0};         // consecutive errors (CONNECT_FAILED, TIMEOUT, HTTP status 5xx or 429)
+    gsBreaker_t breaker {GS_BREAKER_CLOSED}; // circuit breaker state
+    uint32_t backoff {0};       // ms to wait after the last error before the next attempt
+    uint32_t breakerTrips {0};  // number of times the circuit breaker opened
+    uint32_t sendShed {0};      // number of sends rejected because the circuit breaker was open
+    uint32_t putDeferred {0};   // number of times a PUT was held back because the PUT budget was used up
+    uint32_t sendSeq {0};       // number of sends requested
+    uint32_t sendBusy {0};      // number of sends rejected because the queue was full
+    uint32_t sendOK {0};        // number of sends in PUTs that got HTTP OK
+    uint32_t sendLost {0};      // number of sends in PUTs that failed, and were not stored to be sent later, e.g. because the store was full
+    uint8_t queued {0};         // number of sends currently waiting in the queue
+    uint8_t queueMax {0};       // high-water mark for the queue
+    uint8_t batchSize {0};      // number of sends combined into the last PUT
+    uint32_t connFail {0};      // number of connection failures
+    uint32_t recvTimeout {0};   // number of timeouts waiting for server response
+    uint32_t httpOther {0};     // number of non-OK HTTP responses received (i.e. not HTTP status 200)
+    uint16_t httpStatus {0};    // status code of the last response
+    uint32_t dnsTime {0};       // time for the last DNS lookup in milliseconds
+    uint32_t dnsFail {0};       // number of failed DNS lookups
+    uint32_t connTime {0};      // time to connect to server in milliseconds (to start it, for a non-blocking client)
+    uint32_t respTime {0};      // response time in milliseconds
+    uint32_t discTime {0};      // time to disconnect from server in milliseconds
+    uint16_t connRequests {0};  // number of requests sent on the last connection used
+    uint32_t connReused {0};    // number of requests sent on an already-open keep-alive connection
+    uint32_t reconnects {0};    // number of requests resent because a keep-alive connection went stale
+    uint16_t reqBytes {0};      // number of characters in the last request
+    uint8_t reqSegments {0};    // number of writes to the client for the last request
+    uint32_t bytesSent {0};     // total number of characters sent
+    uint32_t runTime {0};       // execution time of the last call to run() in microseconds
+    uint32_t runTimeMax {0};    // longest execution time of run() in microseconds
+    uint32_t backlog {0};       // number of sends in the store
+    uint32_t stored {0};        // number of sends written to the store
+    uint32_t replayed {0};      // number of sends read back from the store
+    int32_t clockAdjust {0};    // ms the clock was adjusted by at the last response with a Date header
+    uint32_t prioOK[GS_PRIORITIES] {};      // number of sends of each priority in PUTs that got HTTP OK
+    uint32_t prioDropped[GS_PRIORITIES] {}; // number of sends of each priority rejected, shed or lost
+#if GS_HISTOGRAMS
+    gsHistogram connHist;       // connect times
+    gsHistogram respHist;       // response times
+    gsHistogram discHist;       // disconnect times
+    gsHistogram queueHist;      // times sends waited in the queue before their PUT started
+    gsHistogram prioHist[GS_PRIORITIES];    // times from queueing sends of each priority until HTTP OK
+#endif
 
 private:
-    ethernetStatus_t _xmit();
+    ethernetStatus_t _run(gsConn& c);
+    bool _connect(gsConn& c);
+    void _sendHeaders(gsConn& c);
+    bool _sendBody(gsConn& c);
+    ethernetStatus_t _putComplete(gsConn& c);
+    void _dequeue(gsConn& c, bool failed = false);
+    bool _retryable(gsConn& c);
+    uint16_t _keep();
+    bool _spillOldest();
+    void _makeRoom(uint16_t len);
+    void _spill(uint8_t n);
+    void _spillAll();
+    void _replay();
+    void _setClock(uint32_t t, uint32_t latency);
+    bool _epochAt(unsigned long ms, uint32_t& sec, uint16_t& msec);
+    bool _timeText(char* buf, unsigned long ms);
+    void _failure();
+    void _success();
+    void _setBreaker(gsBreaker_t state);
+    bool _mayConnect();
+    bool _mayPut();
+    void _spendToken(gsConn& c);
+    bool _batchReady(gsConn& c);
+    bool _bulkFull();
+    void _countSends(gsConn& c, bool ok);
+    void _updatePending();
+    bool _idle();
+    uint16_t _putBatch(gsConn& c, ethernetPacket* packet, uint16_t from = 0, uint16_t to = 0xFFFF);
+    ethernetStatus_t _httpStatus(gsConn& c);
+    bool _retryStale(gsConn& c);
+    void _putItems(batchWriter& w, const char* compID, const char* data);
+    void _addKey(const char* id);
+    void _urlEncode(const char* s);
+    uint16_t _encodedLen(const char* s);
     int dnsLookup(const char* hostname, IPAddress& addr);
+    void _resolve();
+    void _buildHeaders();
+    void _diagReport();
+#if GS_EVENTS > 0
+    void _event(uint8_t code, uint16_t arg);
 
-    Client* m_client;
-    char _localIP[16];
-    char _groveStreamsIP[16];
+    gsEvent _events[GS_EVENTS];
+    uint8_t _evHead {0};        // index of the oldest event
+    uint8_t _nEvents {0};       // number of events in the log
+#endif
+
+    char _hdr[48];              // Host and Connection headers
+    uint8_t _hdrLen {0};
+    bool _hdrKeepAlive {false}; // keepAlive setting when _hdr was built
     const char* _serverName;
     const __FlashStringHelper* _apiKey;
-    const char* _compID;        // component ID
-    const char* _data;
-    unsigned long _msConnect;
-    unsigned long _msConnected;
-    unsigned long _msPutComplete;
-    unsigned long _msLastPacket;
-    unsigned long _msDisconnecting;
-    unsigned long _msDisconnected;
+    uint8_t _apiKeyLen {0};
+    gsQueue _queue;             // sends waiting to be transmitted
+    uint16_t _batchPending {0}; // JSON body size of the queued sends not yet being sent
+    bool _queueFull {false};    // a send was rejected since the last PUT
+    gsPriority_t _priority {GS_BULK}; // priority of the send being built
+    uint8_t _urgentRun {0};     // PUTs in a row that served urgent sends first while bulk sends waited
+    gsConn _conn[GS_MAX_CONN];  // the connection pool
+    uint8_t _nConn;             // number of connections in the pool
+    uint8_t _nextConn {0};      // connection that run() services first
+    uint8_t _lastConn {0};      // connection that received the last response
+    bool _ledOn {false};
+    unsigned long _msDiag {0};  // time of the last diagnostic report
+    unsigned long _msResolved {0}; // time of the last DNS lookup
+    uint32_t _dnsInterval {0};  // ms from the last DNS lookup until the next one
+    bool _dnsValid {false};     // serverIP has been looked up successfully
+    unsigned long _msReplay {0}; // time of the last replay
+    unsigned long _msFail {0};  // time of the last error
+    unsigned long _msOpened {0}; // time the circuit breaker opened
+    ethernetStatus_t _breakerStatus {NO_STATUS}; // circuit breaker transition not yet returned by run()
+    unsigned long _msPut[PUT_BURST] {}; // times of the most recent PUTs, for the rate limit
+    bool _putHeld {false};      // a PUT is being held back for lack of a token
+    uint32_t _epoch {0};        // server time at _msEpoch, seconds since 1970, zero if not known
+    uint16_t _epochMs {0};      // and milliseconds
+    unsigned long _msEpoch {0}; // millis() when the clock was last set
+    unsigned long _msDrift {0}; // start of the current clock drift measurement
+    int32_t _driftAdjust {0};   // total ms the clock has been adjusted by since _msDrift
     int _ledPin;
+    static char _arena[PKTSIZE];    // shared by the packet writer and the response reader, never in use at once
 };
 
-const uint16_t PKTSIZE(300);
 class ethernetPacket
 {
 public:
-    ethernetPacket(Client* client);
+    ethernetPacket(Client* client, char* buf);
     void putChar(const char* c);
     void putChar(const __FlashStringHelper *f);
+    void putChar(char c);
+    void write(const char* buf, uint16_t len);
+    void write_P(PGM_P buf, uint16_t len);
+    template <size_t N> void putFlash(const char (&s)[N]) { write_P(s, N - 1); }  // PROGMEM array, length known at compile time
     void flush();
 
+    uint16_t bytes;         // number of characters written to the client
+    uint8_t segments;       // number of writes to the client
+
 private:
     Client* m_client;
-    char _buf[PKTSIZE];     // the packet
+    char* _buf;             // the packet, PKTSIZE characters
     uint16_t _nchar;        // number of characters in the packet
-    char* _next;            // pointer to the next available position in the packet
 };
 
 #endif
@@ -0,0 +1,280 @@
+// Arduino GroveStreams Library
+// https://github.com/JChristensen/GroveStreams
+// Copyright (C) 2015-2024 by Jack Christensen and licensed under
+// GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+
+// aggregation stage in front of GroveStreams::send(). samples are folded
+// into a fixed table of running min, max, sum and count, one slot per
+// component and datastream, and one summary per component is sent every
+// interval, split over as many sends as it takes to fit in the queue. the
+// number of sensors a gateway can serve is then limited by the size of the
+// table rather than by the GroveStreams PUT budget.
+
+#ifndef GSAGGREGATOR_H_INCLUDED
+#define GSAGGREGATOR_H_INCLUDED
+
+#include <GroveStreams.h>
+
+// number of component/datastream pairs in the table (e.g. -DGS_AGG_SLOTS=16).
+// each one costs about 40 bytes of RAM.
+#ifndef GS_AGG_SLOTS
+#define GS_AGG_SLOTS 8
+#endif
+
+// summary values to send, for gsAggregator::outputs
+const uint8_t GS_AGG_MEAN(1);           // mean, as the datastream itself, e.g. "C"
+const uint8_t GS_AGG_MIN(2);            // minimum, e.g. "C_min"
+const uint8_t GS_AGG_MAX(4);            // maximum, e.g. "C_max"
+const uint8_t GS_AGG_COUNT(8);          // number of samples, e.g. "C_n"
+
+const uint32_t AGG_INTERVAL(300000);    // default ms between summaries
+const uint32_t AGG_RETRY(1000);         // ms to wait before retrying a summary the queue could not take
+
+class gsAggregator
+{
+public:
+    gsAggregator(GroveStreams& gs, uint32_t interval = AGG_INTERVAL) : interval(interval), _gs(gs) {}
+    bool add(const char* compID, const char* data);
+    bool addValue(const char* compID, const char* id, float value);
+    void run();
+    uint8_t used();
+
+    uint32_t interval;          // ms between summaries
+    uint8_t outputs {GS_AGG_MEAN | GS_AGG_MIN | GS_AGG_MAX | GS_AGG_COUNT};
+    uint8_t decimals {2};       // decimal places for the mean, min and max
+    const char* skip {NULL};    // datastream IDs to leave out rather than aggregate, separated by commas, e.g. "s,seq"
+
+    uint32_t samples;           // number of values aggregated
+    uint32_t rejected;          // number of adds refused, because the table was full, a value was not a number, or a summary would not fit in a send
+    uint32_t summaries;         // number of summaries queued for sending
+
+private:
+    static const uint8_t ID_SIZE = 16;      // maximum component ID length, plus one
+    static const uint8_t STREAM_SIZE = 8;   // maximum datastream ID length, plus one
+
+    struct slot
+    {
+        char compID[ID_SIZE];
+        char id[STREAM_SIZE];
+        float min;
+        float max;
+        float sum;
+        uint16_t count;         // zero if the slot is free
+        bool due;               // to be sent in the summary in progress
+    };
+
+    slot* _find(const char* compID, const char* id, bool create);
+    const char* _field(const char* p, char* id, float& value, bool& ok);
+    bool _skipped(const char* id);
+    uint16_t _maxLen(const char* id);
+
+    GroveStreams& _gs;
+    slot _slots[GS_AGG_SLOTS];
+    unsigned long _msSummary;   // time the last summary started
+    unsigned long _msBusy;      // time the queue last could not take a summary
+    bool _sending;              // a summary is being sent, one send per call to run()
+    bool _busy;                 // waiting to retry a summary
+};
+
+// aggregate data in the same form as for GroveStreams::send(), e.g.
+// "&s=1&C=22.5". datastreams in skip are left out. returns false, and
+// aggregates nothing, if a value is not a number, there are not enough free
+// slots, or a datastream's summary is too long for a send. the caller can
+// then send the data as it is.
+inline bool gsAggregator::add(const char* compID, const char* data)
+{
+    char id[STREAM_SIZE];
+    float value;
+    bool ok = true;
+    uint8_t need = 0;
+
+    if (strlen(compID) >= ID_SIZE) ok = false;
+    for (const char* p = data; ok && *p; ) {
+        p = _field(p, id, value, ok);
+        if ( !ok || *id == '\0' || _skipped(id) || _find(compID, id, false) != NULL ) continue;
+        if ( _maxLen(id) > _gs.maxData(compID) ) ok = false;
+        ++need;
+    }
+    if (ok && need > GS_AGG_SLOTS - used()) ok = false;
+    if (!ok) {
+        ++rejected;
+        return false;
+    }
+
+    for (const char* p = data; *p; ) {
+        p = _field(p, id, value, ok);
+        if ( *id && !_skipped(id) ) addValue(compID, id, value);
+    }
+    return true;
+}
+
+// aggregate one value. returns false if the table is full, or if the
+// datastream's summary is too long for a send.
+inline bool gsAggregator::addValue(const char* compID, const char* id, float value)
+{
+    slot* s = _find(compID, id, false);
+    if ( s == NULL && _maxLen(id) <= _gs.maxData(compID) ) s = _find(compID, id, true);
+    if (s == NULL) {
+        ++rejected;
+        return false;
+    }
+    if (s->count == 0xFFFF) return true;    // full, the summary is still good
+    if (s->count == 0 || value < s->min) s->min = value;
+    if (s->count == 0 || value > s->max) s->max = value;
+    s->sum = s->count == 0 ? value : s->sum + value;
+    ++s->count;
+    ++samples;
+    return true;
+}
+
+// call frequently, e.g. from loop(). when the interval has passed, queues a
+// summary for each component, one send per call. a component's datastreams
+// go in as few sends as fit in the queue. if the queue cannot take a send, it
+// is tried again every AGG_RETRY ms, and keeps aggregating in the meantime.
+// any not sent by the next interval go in that interval's summary.
+inline void gsAggregator::run()
+{
+    if (millis() - _msSummary >= interval) {
+        _msSummary = millis();
+        _sending = true;
+        _busy = false;
+        for (uint8_t i = 0; i < GS_AGG_SLOTS; i++) _slots[i].due = _slots[i].count > 0;
+    }
+    if ( !_sending || (_busy && millis() - _msBusy < AGG_RETRY) ) return;
+
+    slot* first = NULL;
+    for (uint8_t i = 0; i < GS_AGG_SLOTS && first == NULL; i++) {
+        if (_slots[i].due) first = &_slots[i];
+    }
+    if (first == NULL) {
+        _sending = false;
+        return;
+    }
+
+    // choose the component's datastreams that fit in one send
+    bool in[GS_AGG_SLOTS];
+    uint16_t room = _gs.maxData(first->compID);
+    uint16_t len = 0;
+    for (uint8_t i = 0; i < GS_AGG_SLOTS; i++) {
+        slot& s = _slots[i];
+        in[i] = s.due && strcmp(s.compID, first->compID) == 0 && len + _maxLen(s.id) <= room;
+        if (in[i]) len += _maxLen(s.id);
+    }
+    if (len == 0) {
+        // settings changed since it was added, and it no longer fits
+        first->count = 0;
+        first->due = false;
+        ++rejected;
+        return;
+    }
+
+    char name[STREAM_SIZE + 4];
+    _gs.sendBegin(first->compID);
+    for (uint8_t i = 0; i < GS_AGG_SLOTS; i++) {
+        slot& s = _slots[i];
+        if (!in[i]) continue;
+        if (outputs & GS_AGG_MEAN) _gs.addFloat(s.id, s.sum / s.count, decimals);
+        if (outputs & GS_AGG_MIN) _gs.addFloat(strcat(strcpy(name, s.id), "_min"), s.min, decimals);
+        if (outputs & GS_AGG_MAX) _gs.addFloat(strcat(strcpy(name, s.id), "_max"), s.max, decimals);
+        if (outputs & GS_AGG_COUNT) _gs.addInt(strcat(strcpy(name, s.id), "_n"), s.count);
+    }
+    _busy = _gs.sendEnd() != SEND_ACCEPTED;
+    if (_busy) {
+        _msBusy = millis();
+    }
+    else {
+        ++summaries;
+        for (uint8_t i = 0; i < GS_AGG_SLOTS; i++) {
+            if (in[i]) {
+                _slots[i].count = 0;
+                _slots[i].due = false;
+            }
+        }
+    }
+}
+
+// the number of slots in use
+inline uint8_t gsAggregator::used()
+{
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < GS_AGG_SLOTS; i++) {
+        if (_slots[i].count > 0) ++n;
+    }
+    return n;
+}
+
+// find the slot for a component's datastream, optionally taking a free one
+// if there is none. returns NULL if not found, or the table is full.
+inline gsAggregator::slot* gsAggregator::_find(const char* compID, const char* id, bool create)
+{
+    slot* free = NULL;
+    for (uint8_t i = 0; i < GS_AGG_SLOTS; i++) {
+        slot& s = _slots[i];
+        if (s.count == 0) {
+            if (free == NULL) free = &s;
+        }
+        else if ( strcmp(s.id, id) == 0 && strcmp(s.compID, compID) == 0 ) {
+            return &s;
+        }
+    }
+    if (!create || free == NULL || strlen(compID) >= ID_SIZE || strlen(id) >= STREAM_SIZE) return NULL;
+    strcpy(free->compID, compID);
+    strcpy(free->id, id);
+    free->due = false;
+    return free;
+}
+
+// true if a datastream ID is in the skip list
+inline bool gsAggregator::_skipped(const char* id)
+{
+    size_t n = strlen(id);
+    for (const char* p = skip; p != NULL && *p; ) {
+        size_t len = strcspn(p, ",");
+        if ( len == n && strncmp(p, id, n) == 0 ) return true;
+        p += len;
+        if (*p) ++p;
+    }
+    return false;
+}
+
+// the longest text that a datastream's summary can add to a send: for each
+// output, "&", the ID and any suffix, "=", and the value. a count has at
+// most 5 digits. other values have a sign, a decimal point, and up to 10
+// digits, as addFloat() formats them as 32-bit fixed point, or decimals + 1
+// if that is more.
+inline uint16_t gsAggregator::_maxLen(const char* id)
+{
+    uint8_t name = strlen(id) + 2;
+    uint8_t value = (decimals < 10 ? 10 : decimals + 1) + 2;
+    uint16_t len = 0;
+    if (outputs & GS_AGG_MEAN) len += name + value;
+    if (outputs & GS_AGG_MIN) len += name + 4 + value;
+    if (outputs & GS_AGG_MAX) len += name + 4 + value;
+    if (outputs & GS_AGG_COUNT) len += name + 2 + 5;
+    return len;
+}
+
+// parse the "id=value" field at p, skipping any leading '&' or '?'. sets ok
+// to false if the ID is too long, the value is not a number, or the field is
+// a sample time, which cannot be aggregated. id is empty if there is no
+// field. returns a pointer to the next field.
+inline const char* gsAggregator::_field(const char* p, char* id, float& value, bool& ok)
+{
+    while (*p == '&' || *p == '?') ++p;
+    const char* end = p + strcspn(p, "&");
+    const char* eq = (const char*)memchr(p, '=', end - p);
+    *id = '\0';
+    if (p == end) return end;
+    if (eq == NULL || eq == p || eq - p >= STREAM_SIZE) {
+        ok = false;
+        return end;
+    }
+    memcpy(id, p, eq - p);
+    id[eq - p] = '\0';
+    if (strcmp_P(id, PSTR("time")) == 0) ok = false;
+    char* numEnd;
+    value = strtod(eq + 1, &numEnd);
+    if (numEnd == eq + 1 || numEnd != end) ok = false;
+    return end;
+}
+#endif
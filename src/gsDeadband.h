@@ -0,0 +1,200 @@
+// Arduino GroveStreams Library
+// https://github.com/JChristensen/GroveStreams
+// Copyright (C) 2015-2024 by Jack Christensen and licensed under
+// GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+
+// deadband filter for slowly changing datastreams. a value is only reported
+// when it has moved more than a threshold, absolute or a percentage, from
+// the last value reported, or when the stream has been silent for its
+// heartbeat interval. the last reported values are kept in a compact table,
+// keyed by a 16-bit hash of the component and datastream IDs. it does not
+// depend on a GroveStreams object, so it can also be used on a sensor node
+// to save radio traffic.
+
+#ifndef GSDEADBAND_H_INCLUDED
+#define GSDEADBAND_H_INCLUDED
+
+#include <Arduino.h>
+
+// number of datastream IDs that can have a rule (e.g. -DGS_DB_RULES=8).
+// each one costs 17 bytes of RAM.
+#ifndef GS_DB_RULES
+#define GS_DB_RULES 4
+#endif
+
+// number of component/datastream pairs whose last reported value is kept
+// (e.g. -DGS_DB_SLOTS=32). each one costs 10 bytes of RAM. when the table
+// is full, the pair reported longest ago is dropped.
+#ifndef GS_DB_SLOTS
+#define GS_DB_SLOTS 8
+#endif
+
+const uint32_t DB_HEARTBEAT(3600000);   // default maximum ms between reports of a datastream
+
+class gsDeadband
+{
+public:
+    bool setRule(const char* id, float threshold, bool percent = false, uint32_t heartbeat = DB_HEARTBEAT);
+    bool changed(const char* compID, const char* id, float value);
+    bool filter(const char* compID, char* data);
+    uint8_t suppression();
+
+    uint32_t (*clock)() {NULL};     // time source in ms, NULL for millis(), e.g. from an RTC on a node that sleeps
+
+    uint32_t passed;            // number of values reported
+    uint32_t suppressed;        // number of values suppressed
+
+private:
+    static const uint8_t ID_SIZE = 8;   // maximum datastream ID length, plus one
+
+    struct rule
+    {
+        char id[ID_SIZE];       // empty if the rule is not used
+        float threshold;
+        uint32_t heartbeat;     // zero for no heartbeat
+        bool percent;           // threshold is a percentage of the last reported value
+    };
+
+    struct slot
+    {
+        uint16_t key;           // hash of the component and datastream IDs, zero if the slot is free
+        float value;            // last value reported
+        uint32_t ms;            // time it was reported
+    };
+
+    uint32_t _now() { return clock ? clock() : millis(); }
+    uint16_t _hash(const char* compID, const char* id, uint8_t idLen);
+    rule* _rule(const char* id, uint8_t idLen);
+
+    rule _rules[GS_DB_RULES];
+    slot _slots[GS_DB_SLOTS];
+};
+
+// filter the datastream id (in any component) with the given threshold. a
+// value is reported if it differs from the last one reported by more than
+// threshold, or by more than threshold percent of it if percent is true.
+// it is also reported if heartbeat ms have passed since the last report,
+// zero for no heartbeat. datastreams without a rule are always reported.
+// returns false if the ID is too long or there is no room for another rule.
+inline bool gsDeadband::setRule(const char* id, float threshold, bool percent, uint32_t heartbeat)
+{
+    uint8_t len = strlen(id);
+    if (len == 0 || len >= ID_SIZE) return false;
+    rule* r = _rule(id, len);
+    for (uint8_t i = 0; i < GS_DB_RULES && r == NULL; i++) {
+        if (_rules[i].id[0] == '\0') r = &_rules[i];
+    }
+    if (r == NULL) return false;
+    strcpy(r->id, id);
+    r->threshold = threshold;
+    r->percent = percent;
+    r->heartbeat = heartbeat;
+    return true;
+}
+
+// true if the value should be reported. if so, it becomes the value that
+// later ones are compared to, so call this only when the value will be sent.
+inline bool gsDeadband::changed(const char* compID, const char* id, float value)
+{
+    uint8_t idLen = strlen(id);
+    rule* r = _rule(id, idLen);
+    if (r == NULL) return true;
+
+    uint16_t key = _hash(compID, id, idLen);
+    uint32_t ms = _now();
+    slot* s = NULL;
+    slot* oldest = &_slots[0];
+    for (uint8_t i = 0; i < GS_DB_SLOTS && s == NULL; i++) {
+        slot& t = _slots[i];
+        if (t.key == key) s = &t;
+        else if ( oldest->key != 0 && (t.key == 0 || ms - t.ms > ms - oldest->ms) ) oldest = &t;
+    }
+
+    if (s != NULL) {
+        float delta = fabs(value - s->value);
+        float threshold = r->percent ? fabs(s->value) * r->threshold / 100 : r->threshold;
+        if ( delta <= threshold && (r->heartbeat == 0 || ms - s->ms < r->heartbeat) ) {
+            ++suppressed;
+            return false;
+        }
+    }
+    else {
+        s = oldest;
+        s->key = key;
+    }
+    s->value = value;
+    s->ms = ms;
+    ++passed;
+    return true;
+}
+
+// filter the datastreams in data, in the same form as for
+// GroveStreams::send(), e.g. "&s=1&C=22.5", removing those whose values are
+// suppressed. datastreams without a rule are kept. returns false if every
+// datastream with a rule was suppressed, so the data need not be sent.
+inline bool gsDeadband::filter(const char* compID, char* data)
+{
+    bool send = false;
+    bool filtered = false;
+    char* out = data;
+    const char* p = data;
+
+    while (*p) {
+        const char* field = p;
+        const char* end = p + strcspn(p + 1, "&?") + 1;   // fields start with '&' or '?'
+        const char* id = field;
+        while (*id == '&' || *id == '?') ++id;
+        const char* eq = (const char*)memchr(id, '=', end - id);
+        bool keep = true;
+        if (eq != NULL && _rule(id, eq - id) != NULL) {
+            char* numEnd;
+            float value = strtod(eq + 1, &numEnd);
+            if (numEnd == end && numEnd != eq + 1) {
+                char name[ID_SIZE];
+                memcpy(name, id, eq - id);
+                name[eq - id] = '\0';
+                filtered = true;
+                keep = changed(compID, name, value);
+                send |= keep;
+            }
+        }
+        if (keep) {
+            memmove(out, field, end - field);
+            out += end - field;
+        }
+        p = end;
+    }
+    *out = '\0';
+    return send || !filtered;
+}
+
+// the percentage of filtered values that were suppressed
+inline uint8_t gsDeadband::suppression()
+{
+    uint32_t n = passed + suppressed;
+    return n == 0 ? 0 : (uint8_t)(100.0 * suppressed / n);
+}
+
+// 16-bit FNV-1a hash of "compID\0id", never zero
+inline uint16_t gsDeadband::_hash(const char* compID, const char* id, uint8_t idLen)
+{
+    uint32_t h = 2166136261UL;
+    do {
+        h = (h ^ (uint8_t)*compID) * 16777619UL;
+    } while (*compID++);
+    for (uint8_t i = 0; i < idLen; i++) h = (h ^ (uint8_t)id[i]) * 16777619UL;
+    uint16_t key = (h >> 16) ^ (h & 0xFFFF);
+    return key == 0 ? 1 : key;
+}
+
+// find the rule for the first idLen characters of id, NULL if none
+inline gsDeadband::rule* gsDeadband::_rule(const char* id, uint8_t idLen)
+{
+    if (idLen >= ID_SIZE) return NULL;
+    for (uint8_t i = 0; i < GS_DB_RULES; i++) {
+        rule& r = _rules[i];
+        if ( r.id[0] != '\0' && strncmp(r.id, id, idLen) == 0 && r.id[idLen] == '\0' ) return &r;
+    }
+    return NULL;
+}
+#endif
@@ -0,0 +1,105 @@
+// Arduino GroveStreams Library
+// https://github.com/JChristensen/GroveStreams
+// Copyright (C) 2015-2024 by Jack Christensen and licensed under
+// GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+
+// gsStore kept in EEPROM, as a ring buffer of "compID\0data\0" records
+// after a small header. only a few hundred bytes are available on most
+// boards, so this suits short outages. EEPROM wears out after about
+// 100,000 writes to each cell, so size the network retry settings so that
+// failing sends are not stored and replayed over and over.
+
+#ifndef GSEEPROMSTORE_H_INCLUDED
+#define GSEEPROMSTORE_H_INCLUDED
+
+#include <GroveStreams.h>
+#include <EEPROM.h>
+
+class gsEepromStore : public gsStore
+{
+public:
+    // use size bytes of EEPROM from address start, zero for all of the rest
+    gsEepromStore(uint16_t start = 0, uint16_t size = 0) : _start(start), _size(size) {}
+    void begin();
+    bool append(const char* compID, const char* data, const char* more);
+    uint16_t peek(char* buf, uint16_t size);
+    void pop();
+    uint32_t count() { return _hdr.count; }
+
+private:
+    void _write(const char* s, bool terminate);
+    uint16_t _cap() { return _size - sizeof(_hdr); }
+    uint16_t _addr(uint16_t i) { return _start + sizeof(_hdr) + i % _cap(); }
+
+    static const uint8_t MAGIC = 0x47;
+    struct
+    {
+        uint8_t magic;
+        uint16_t head;      // ring offset of the oldest record
+        uint16_t tail;      // ring offset where the next record is written
+        uint16_t count;     // number of records
+    } _hdr;
+    uint16_t _start;
+    uint16_t _size;
+};
+
+// read the header, and start over if it is not valid
+inline void gsEepromStore::begin()
+{
+    if (_size == 0) _size = EEPROM.length() - _start;
+    EEPROM.get(_start, _hdr);
+    if (_hdr.magic != MAGIC || _hdr.head >= _cap() || _hdr.tail >= _cap()) {
+        _hdr.magic = MAGIC;
+        _hdr.head = _hdr.tail = _hdr.count = 0;
+        EEPROM.put(_start, _hdr);
+    }
+}
+
+inline bool gsEepromStore::append(const char* compID, const char* data, const char* more)
+{
+    uint16_t len = strlen(compID) + strlen(data) + strlen(more) + 2;
+    uint16_t used = (_hdr.tail + _cap() - _hdr.head) % _cap();
+    if (used + len >= _cap()) return false;
+
+    _write(compID, true);
+    _write(data, false);
+    _write(more, true);
+    ++_hdr.count;
+    EEPROM.put(_start, _hdr);
+    return true;
+}
+
+// write a string at the tail, optionally with its terminator
+inline void gsEepromStore::_write(const char* s, bool terminate)
+{
+    do {
+        if (*s == '\0' && !terminate) break;
+        EEPROM.update( _addr(_hdr.tail), *s );
+        _hdr.tail = (_hdr.tail + 1) % _cap();
+    } while (*s++);
+}
+
+inline uint16_t gsEepromStore::peek(char* buf, uint16_t size)
+{
+    if (_hdr.count == 0) return 0;
+
+    uint16_t len = 0;
+    uint8_t nul = 0;
+    while (nul < 2) {
+        char c = EEPROM.read( _addr(_hdr.head + len) );
+        if (len < size) buf[len] = c;
+        ++len;
+        if (c == '\0') ++nul;
+    }
+    return len;
+}
+
+inline void gsEepromStore::pop()
+{
+    if (_hdr.count == 0) return;
+    _hdr.head = (_hdr.head + peek(NULL, 0)) % _cap();
+    --_hdr.count;
+    EEPROM.put(_start, _hdr);
+}
+
+#endif
@@ -0,0 +1,134 @@
+// Arduino GroveStreams Library
+// https://github.com/JChristensen/GroveStreams
+// Copyright (C) 2015-2024 by Jack Christensen and licensed under
+// GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+
+// gsStore kept in a file, for builds on a host with a file system, e.g.
+// Linux. records are appended to the data file as "compID\tdata\n" lines.
+// the offset of the oldest record is kept in a second file, so the backlog
+// survives a restart. the data file is emptied once every record is read.
+
+#ifndef GSFILESTORE_H_INCLUDED
+#define GSFILESTORE_H_INCLUDED
+
+#include <GroveStreams.h>
+#include <stdio.h>
+
+class gsFileStore : public gsStore
+{
+public:
+    gsFileStore(const char* dataPath, const char* posPath, uint32_t maxBytes = 1000000UL)
+        : _dataPath(dataPath), _posPath(posPath), _maxBytes(maxBytes), _pos(0), _next(0), _size(0), _count(0) {}
+    void begin();
+    bool append(const char* compID, const char* data, const char* more);
+    uint16_t peek(char* buf, uint16_t size);
+    void pop();
+    uint32_t count() { return _count; }
+
+private:
+    void _savePos();
+
+    const char* _dataPath;
+    const char* _posPath;
+    uint32_t _maxBytes;     // maximum size of the data file
+    uint32_t _pos;          // offset of the oldest record
+    uint32_t _next;         // offset of the record after it, zero if not known
+    uint32_t _size;         // size of the data file
+    uint32_t _count;        // number of records from _pos to the end of the file
+};
+
+// find the oldest record and count the records
+inline void gsFileStore::begin()
+{
+    FILE* f = fopen(_posPath, "r");
+    _pos = _next = _size = _count = 0;
+    if (f != NULL) {
+        unsigned long pos;
+        if (fscanf(f, "%lu", &pos) == 1) _pos = pos;
+        fclose(f);
+    }
+    f = fopen(_dataPath, "r");
+    if (f != NULL) {
+        fseek(f, 0, SEEK_END);
+        _size = ftell(f);
+        if (_pos > _size) _pos = _size;
+        fseek(f, _pos, SEEK_SET);
+        int c;
+        while ( (c = fgetc(f)) != EOF ) {
+            if (c == '\n') ++_count;
+        }
+        fclose(f);
+    }
+    else {
+        _pos = 0;       // no data file, so the saved position is stale
+    }
+}
+
+inline bool gsFileStore::append(const char* compID, const char* data, const char* more)
+{
+    uint32_t len = strlen(compID) + strlen(data) + strlen(more) + 2;
+    if (_size + len > _maxBytes) return false;
+
+    FILE* f = fopen(_dataPath, "a");
+    if (f == NULL) return false;
+    bool ok = fprintf(f, "%s\t%s%s\n", compID, data, more) == (int)len;
+    ok = (fclose(f) == 0) && ok;
+    if (ok) {
+        _size += len;
+        ++_count;
+    }
+    return ok;
+}
+
+inline uint16_t gsFileStore::peek(char* buf, uint16_t size)
+{
+    if (_count == 0) return 0;
+
+    FILE* f = fopen(_dataPath, "r");
+    if (f == NULL) return 0;
+    fseek(f, _pos, SEEK_SET);
+    uint16_t len = 0;
+    bool tab = false;
+    int c;
+    while ( (c = fgetc(f)) != EOF && c != '\n' ) {
+        if (c == '\t' && !tab) {
+            tab = true;
+            c = '\0';
+        }
+        if (len < size) buf[len] = c;
+        ++len;
+    }
+    fclose(f);
+    if (len < size) buf[len] = '\0';
+    _next = _pos + len + 1;
+    return len + 1;
+}
+
+inline void gsFileStore::pop()
+{
+    if (_count == 0) return;
+    if (_next <= _pos) peek(NULL, 0);
+    _pos = _next;
+    _next = 0;
+    if (--_count == 0) {
+        // save the position first, so that a reset in between does not
+        // leave it pointing past the end of the emptied file
+        _pos = _size = 0;
+        _savePos();
+        FILE* f = fopen(_dataPath, "w");        // empty the data file
+        if (f != NULL) fclose(f);
+    }
+    else {
+        _savePos();
+    }
+}
+
+inline void gsFileStore::_savePos()
+{
+    FILE* f = fopen(_posPath, "w");
+    if (f == NULL) return;
+    fprintf(f, "%lu\n", (unsigned long)_pos);
+    fclose(f);
+}
+
+#endif
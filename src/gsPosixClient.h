@@ -0,0 +1,356 @@
+// Arduino GroveStreams Library
+// https://github.com/JChristensen/GroveStreams
+// Copyright (C) 2015-2024 by Jack Christensen and licensed under
+// GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+
+// Client for Linux hosts, using non-blocking sockets and an epoll event
+// loop, so that a GroveStreams connection pool (GS_MAX_CONN) can have many
+// requests in progress at once without blocking run(). connect() returns
+// as soon as the connection is started; anything written before it
+// completes, or while the socket is busy, is held in a buffer and sent when
+// the socket is writable; only if the buffer fills does write() wait for the
+// socket. call gsPosixLoop::poll() from the main loop along with
+// GroveStreams::run(); it waits for socket activity, for at most the given
+// time, and sends the buffered data.
+//
+// build the library with GS_POSIX defined so that it does not need the
+// Ethernet library.
+
+#ifndef GSPOSIXCLIENT_H_INCLUDED
+#define GSPOSIXCLIENT_H_INCLUDED
+
+#if !defined(__linux__)
+#error "gsPosixClient needs Linux (epoll)"
+#endif
+
+#include <Arduino.h>
+#include <Client.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <Streaming.h>      // https://github.com/janelia-arduino/Streaming
+
+// bytes a client can hold while its socket is not writable, enough for the
+// largest request (headers and a batchBytes body)
+#ifndef GS_POSIX_TXBUF
+#define GS_POSIX_TXBUF 2048
+#endif
+
+// milliseconds that write() waits for the socket to take more data once the
+// buffer is full, before it gives up and drops the connection
+#ifndef GS_POSIX_TXWAIT
+#define GS_POSIX_TXWAIT 5000
+#endif
+
+class gsPosixClient;
+
+// the epoll instance shared by a set of clients
+class gsPosixLoop
+{
+public:
+    gsPosixLoop() : _fd(-1) {}
+    ~gsPosixLoop() { if (_fd >= 0) close(_fd); }
+    bool begin();
+    int poll(int timeout);
+
+private:
+    friend class gsPosixClient;
+    int _fd;
+};
+
+class gsPosixClient : public Client
+{
+public:
+    gsPosixClient(gsPosixLoop& loop)
+        : bytesSent(0), bytesReceived(0), connects(0), connectTime(0), txWaits(0),
+          _loop(loop), _fd(-1), _txLen(0), _connecting(false), _eof(false), _msConnect(0) {}
+    ~gsPosixClient() { stop(); }
+    int connect(IPAddress ip, uint16_t port);
+    int connect(const char* host, uint16_t port);
+    size_t write(uint8_t b) { return write(&b, 1); }
+    size_t write(const uint8_t* buf, size_t size);
+    int available();
+    int read();
+    int read(uint8_t* buf, size_t size);
+    int peek();
+    void flush() {}
+    void stop();
+    uint8_t connected();
+    operator bool() { return _fd >= 0; }
+
+    uint32_t bytesSent;         // total number of bytes written to the socket
+    uint32_t bytesReceived;     // total number of bytes read from the socket
+    uint32_t connects;          // number of connections started
+    uint32_t connectTime;       // ms the last connection took to complete or fail
+    uint32_t txWaits;           // number of times write() waited for a full buffer to drain
+
+private:
+    friend class gsPosixLoop;
+    void _event(uint32_t events);
+    void _connectDone();
+    bool _drain();
+    bool _send();
+    void _watch(int op);
+    void _closeSocket();
+
+    gsPosixLoop& _loop;
+    int _fd;
+    uint16_t _txLen;            // bytes waiting in _tx
+    bool _connecting;           // connect() has not completed
+    bool _eof;                  // the server closed the connection, or it failed
+    uint32_t _msConnect;        // millis() when connect() was called
+    uint8_t _tx[GS_POSIX_TXBUF];
+};
+
+// create the epoll instance. returns false if it fails.
+inline bool gsPosixLoop::begin()
+{
+    if (_fd < 0) _fd = epoll_create1(EPOLL_CLOEXEC);
+    return _fd >= 0;
+}
+
+// wait up to timeout ms for activity on any of the clients' sockets, and
+// handle it. returns the number of sockets that had activity, or -1 on error.
+inline int gsPosixLoop::poll(int timeout)
+{
+    const int MAX_EVENTS = 64;
+    struct epoll_event ev[MAX_EVENTS];
+
+    int n = epoll_wait(_fd, ev, MAX_EVENTS, timeout);
+    for (int i = 0; i < n; i++) {
+        ( (gsPosixClient*)ev[i].data.ptr )->_event(ev[i].events);
+    }
+    return n < 0 && errno == EINTR ? 0 : n;
+}
+
+// start connecting to the server. returns 1 if the connection is complete
+// or in progress, 0 if it failed at once.
+inline int gsPosixClient::connect(IPAddress ip, uint16_t port)
+{
+    stop();
+    _fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (_fd < 0) return 0;
+    int one = 1;
+    setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    uint8_t* a = (uint8_t*)&addr.sin_addr.s_addr;
+    for (uint8_t i = 0; i < 4; i++) a[i] = ip[i];
+
+    _txLen = 0;
+    _eof = false;
+    _msConnect = millis();
+    ++connects;
+    _connecting = ::connect(_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0;
+    if (_connecting && errno != EINPROGRESS) {
+        _closeSocket();
+        connectTime = millis() - _msConnect;
+        return 0;
+    }
+    if (!_connecting) connectTime = millis() - _msConnect;
+    _watch(EPOLL_CTL_ADD);
+    return 1;
+}
+
+// look up the host, then connect as above
+inline int gsPosixClient::connect(const char* host, uint16_t port)
+{
+    struct addrinfo hints;
+    struct addrinfo* res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if ( getaddrinfo(host, NULL, &hints, &res) != 0 ) return 0;
+    const uint8_t* a = (const uint8_t*)&( (struct sockaddr_in*)res->ai_addr )->sin_addr.s_addr;
+    IPAddress ip(a[0], a[1], a[2], a[3]);
+    freeaddrinfo(res);
+    return connect(ip, port);
+}
+
+// send what the socket will take now, and buffer the rest. if the buffer
+// fills, waits for the socket to take some of it. returns the number of
+// bytes accepted, which is less than size only if the connection has failed,
+// or the socket took nothing for GS_POSIX_TXWAIT ms; the connection is then
+// dropped, so that the request fails rather than going out cut short.
+inline size_t gsPosixClient::write(const uint8_t* buf, size_t size)
+{
+    if (_fd < 0 || _eof) return 0;
+    size_t n = 0;
+    if (_txLen == 0 && !_connecting) {
+        ssize_t k = send(_fd, buf, size, MSG_NOSIGNAL);
+        if (k < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            _eof = true;
+            return 0;
+        }
+        if (k > 0) {
+            n = k;
+            bytesSent += k;
+        }
+    }
+    while (n < size) {
+        if (_txLen == GS_POSIX_TXBUF && !_drain()) {
+            Serial << millis() << F(" gsPosixClient: write failed, ") << size - n << F(" bytes not sent\n");
+            _eof = true;
+            _txLen = 0;
+            _watch(EPOLL_CTL_MOD);
+            return n;
+        }
+        size_t room = GS_POSIX_TXBUF - _txLen;
+        size_t rest = size - n < room ? size - n : room;
+        bool wasEmpty = (_txLen == 0);
+        memcpy(_tx + _txLen, buf + n, rest);
+        _txLen += rest;
+        n += rest;
+        if (wasEmpty && !_connecting) _watch(EPOLL_CTL_MOD);    // wait until writable
+    }
+    return n;
+}
+
+// wait for the socket to finish connecting, if need be, and to take some of
+// the buffered data. returns false if the connection fails, or nothing could
+// be sent for GS_POSIX_TXWAIT ms.
+inline bool gsPosixClient::_drain()
+{
+    ++txWaits;
+    uint32_t ms = millis();
+    while (millis() - ms < GS_POSIX_TXWAIT) {
+        struct pollfd p;
+        p.fd = _fd;
+        p.events = POLLOUT;
+        p.revents = 0;
+        int k = ::poll( &p, 1, GS_POSIX_TXWAIT - (millis() - ms) );
+        if (k < 0 && errno != EINTR) return false;
+        if (k <= 0) continue;
+        if (_connecting) _connectDone();
+        if (_eof || (p.revents & (POLLERR | POLLHUP))) return false;
+        uint16_t was = _txLen;
+        if ( !_send() ) return false;
+        if (_txLen < was) return true;
+    }
+    return false;
+}
+
+inline int gsPosixClient::available()
+{
+    if (_fd < 0 || _connecting) return 0;
+    int n = 0;
+    if (ioctl(_fd, FIONREAD, &n) < 0) return 0;
+    return n;
+}
+
+inline int gsPosixClient::read()
+{
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+// read what has arrived, up to size bytes. returns the number read, or -1
+// if there is nothing.
+inline int gsPosixClient::read(uint8_t* buf, size_t size)
+{
+    if (_fd < 0 || _connecting) return -1;
+    ssize_t n = recv(_fd, buf, size, 0);
+    if (n > 0) {
+        bytesReceived += n;
+        return n;
+    }
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) _eof = true;
+    return -1;
+}
+
+inline int gsPosixClient::peek()
+{
+    uint8_t b;
+    if (_fd < 0 || _connecting) return -1;
+    return recv(_fd, &b, 1, MSG_PEEK) == 1 ? b : -1;
+}
+
+inline void gsPosixClient::stop()
+{
+    if (_fd >= 0) _closeSocket();
+    _txLen = 0;
+    _connecting = false;
+    _eof = false;
+}
+
+// true while the connection is open or still being made, or while there is
+// unread data after the server closed it
+inline uint8_t gsPosixClient::connected()
+{
+    if (_fd < 0) return 0;
+    if (!_eof && !_connecting) {
+        // notice a close by the server without waiting for poll()
+        uint8_t b;
+        ssize_t n = recv(_fd, &b, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) _eof = true;
+    }
+    return !_eof || available() > 0;
+}
+
+// handle activity on the socket: the connection completing or failing, the
+// socket becoming writable, or the server closing the connection. incoming
+// data is left in the socket until it is read.
+inline void gsPosixClient::_event(uint32_t events)
+{
+    if (_fd < 0) return;
+    if ( _connecting && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) ) _connectDone();
+    if ( !_connecting && _txLen > 0 && (events & EPOLLOUT) && !_send() ) _eof = true;
+    if ( events & (EPOLLERR | EPOLLRDHUP | EPOLLHUP) ) {
+        if ( available() == 0 ) _eof = true;
+    }
+    _watch(EPOLL_CTL_MOD);
+}
+
+// the socket has finished connecting, or failed to
+inline void gsPosixClient::_connectDone()
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(_fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    _connecting = false;
+    connectTime = millis() - _msConnect;
+    if (err != 0) {
+        _eof = true;
+        _txLen = 0;
+    }
+}
+
+// send buffered data. returns false if the connection has failed.
+inline bool gsPosixClient::_send()
+{
+    ssize_t k = send(_fd, _tx, _txLen, MSG_NOSIGNAL);
+    if (k < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+    bytesSent += k;
+    _txLen -= k;
+    memmove(_tx, _tx + k, _txLen);
+    return true;
+}
+
+// register the socket with the loop, waiting for it to become writable only
+// while connecting or while there is buffered data, and not at all once the
+// connection has failed
+inline void gsPosixClient::_watch(int op)
+{
+    struct epoll_event ev;
+    ev.events = _eof ? 0 : EPOLLIN | EPOLLRDHUP | (_connecting || _txLen > 0 ? (uint32_t)EPOLLOUT : 0);
+    ev.data.ptr = this;
+    epoll_ctl(_loop._fd, op, _fd, &ev);
+}
+
+inline void gsPosixClient::_closeSocket()
+{
+    epoll_ctl(_loop._fd, EPOLL_CTL_DEL, _fd, NULL);
+    close(_fd);
+    _fd = -1;
+}
+#endif
@@ -0,0 +1,141 @@
+// Arduino GroveStreams Library
+// https://github.com/JChristensen/GroveStreams
+// Copyright (C) 2015-2024 by Jack Christensen and licensed under
+// GNU GPL v3.0, https://www.gnu.org/licenses/gpl.html
+
+// gsStore kept on an SD card, e.g. the one on the Ethernet shield. records
+// are appended to the data file as "compID\tdata\n" lines. the offset of the
+// oldest record is kept in a second file, so the backlog survives a reset.
+// the data file is removed once every record is read. call SD.begin()
+// before gsSdStore::begin().
+
+#ifndef GSSDSTORE_H_INCLUDED
+#define GSSDSTORE_H_INCLUDED
+
+#include <GroveStreams.h>
+#include <SD.h>
+
+class gsSdStore : public gsStore
+{
+public:
+    gsSdStore(const char* dataPath = "GSDATA.TXT", const char* posPath = "GSPOS.BIN", uint32_t maxBytes = 1000000UL)
+        : _dataPath(dataPath), _posPath(posPath), _maxBytes(maxBytes), _pos(0), _next(0), _size(0), _count(0) {}
+    void begin();
+    bool append(const char* compID, const char* data, const char* more);
+    uint16_t peek(char* buf, uint16_t size);
+    void pop();
+    uint32_t count() { return _count; }
+
+private:
+    void _savePos();
+
+    const char* _dataPath;
+    const char* _posPath;
+    uint32_t _maxBytes;     // maximum size of the data file
+    uint32_t _pos;          // offset of the oldest record
+    uint32_t _next;         // offset of the record after it, zero if not known
+    uint32_t _size;         // size of the data file
+    uint32_t _count;        // number of records from _pos to the end of the file
+};
+
+// find the oldest record and count the records
+inline void gsSdStore::begin()
+{
+    _pos = _next = _size = _count = 0;
+    File f = SD.open(_posPath, FILE_READ);
+    if (f) {
+        f.read( (uint8_t*)&_pos, sizeof(_pos) );
+        f.close();
+    }
+    f = SD.open(_dataPath, FILE_READ);
+    if (f) {
+        _size = f.size();
+        if (_pos > _size) _pos = _size;
+        f.seek(_pos);
+        uint8_t buf[32];
+        int n;
+        while ( (n = f.read(buf, sizeof(buf))) > 0 ) {
+            for (int i = 0; i < n; i++) {
+                if (buf[i] == '\n') ++_count;
+            }
+        }
+        f.close();
+    }
+    else {
+        _pos = 0;       // no data file, so the saved position is stale
+    }
+}
+
+inline bool gsSdStore::append(const char* compID, const char* data, const char* more)
+{
+    uint32_t len = strlen(compID) + strlen(data) + strlen(more) + 2;
+    if (_size + len > _maxBytes) return false;
+
+    File f = SD.open(_dataPath, FILE_WRITE);
+    if (!f) return false;
+    size_t n = f.print(compID);
+    n += f.print('\t');
+    n += f.print(data);
+    n += f.print(more);
+    n += f.print('\n');
+    f.close();
+    if (n != len) return false;
+    _size += len;
+    ++_count;
+    return true;
+}
+
+inline uint16_t gsSdStore::peek(char* buf, uint16_t size)
+{
+    if (_count == 0) return 0;
+
+    File f = SD.open(_dataPath, FILE_READ);
+    if (!f) return 0;
+    f.seek(_pos);
+    uint16_t len = 0;
+    bool tab = false;
+    int c;
+    while ( (c = f.read()) >= 0 && c != '\n' ) {
+        if (c == '\t' && !tab) {
+            tab = true;
+            c = '\0';
+        }
+        if (len < size) buf[len] = c;
+        ++len;
+    }
+    f.close();
+    if (len < size) buf[len] = '\0';
+    _next = _pos + len + 1;
+    return len + 1;
+}
+
+inline void gsSdStore::pop()
+{
+    if (_count == 0) return;
+    if (_next <= _pos) peek(NULL, 0);
+    _pos = _next;
+    _next = 0;
+    if (--_count == 0) {
+        // save the position first, so that a reset in between does not
+        // leave it pointing into a file that is gone
+        _pos = _size = 0;
+        _savePos();
+        SD.remove(_dataPath);
+    }
+    else {
+        _savePos();
+    }
+}
+
+// overwrite the position file in place. FILE_WRITE includes O_APPEND, which
+// would make every write go to the end of the file, whatever the seek.
+inline void gsSdStore::_savePos()
+{
+    File f = SD.open(_posPath, O_WRITE | O_CREAT);
+    if (!f) return;
+    f.seek(0);
+    f.write( (const uint8_t*)&_pos, sizeof(_pos) );
+    f.close();
+}
+
+#endif